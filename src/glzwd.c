@@ -5,10 +5,18 @@
 #ifdef TESTDEV
 #include <stdio.h>
 #endif
-/* stdlib.h for calloc()/free(). */
+/* string.h for memcpy(); stdlib.h for calloc()/free(). */
+#include <string.h>
 #include <stdlib.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
 
 #include "glzwd.h"
+#define GLZW_LOAD_LE64
+#include "glzwint.h"
 
 #ifdef TESTDEV
 int print_dec_codes;                            /* Temp for dev. */
@@ -21,6 +29,127 @@ enum { LZW_INITIAL, LZW_FINISHED,
 /* values of control_state */
 enum { ST_INITIAL, ST_NORMAL };
 
+/* return values of glzwd_bulk() */
+enum { BULK_EDGE, BULK_END, BULK_INVALID, BULK_CODE };
+
+/* glzwd_bulk() refills its bit buffer 8 bytes at a time. */
+#define BULK_MIN_IN  8
+
+/* Codes unpacked at a time, and the fewest worth unpacking as a batch. */
+#define BATCH_SIZE      64
+#define BATCH_MIN       8
+
+/* unpack_codes() may read this many bytes past the last code. */
+#define UNPACK_SLACK    16
+
+/* With GLZWD_OPT_SLACK, strings up to this long are kept in inl[] and
+ * written with one store of this many bytes. */
+#define INLINE_LEN      8
+
+/* Unpack n codes, each width bits, starting bit bits into in[].
+ *
+ * Eight codes take exactly width bytes, so every group of eight has the
+ * same layout: code k starts in byte (bit + k * width) / 8, spans at most
+ * three bytes, and is shifted right by (bit + k * width) % 8.  The SIMD
+ * versions gather those three bytes into a 32-bit lane with a byte
+ * shuffle, shift each lane by its own count, mask, and narrow to 16 bits.
+ * SSE4.1 has no per-lane shift, so it multiplies each lane left by
+ * 2^(7 - shift) and shifts all lanes right by 7 instead.
+ */
+static void unpack_codes(const GLZWByte *in, GLZWUint bit, GLZWUint width,
+        GLZWUint n, GLZWUshort *codes)
+{
+    GLZWUint i = 0, k, b, mask = (1 << width) - 1;
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    GLZWByte shuf[32];
+    GLZWUint shift[8];
+    for (k = 0; k < 8; k++) {
+        b = bit + k * width;
+        shuf[4 * k] = b >> 3;
+        shuf[4 * k + 1] = (b >> 3) + 1;
+        shuf[4 * k + 2] = (b >> 3) + 2;
+        shuf[4 * k + 3] = 0x80;
+#if defined(__AVX2__)
+        shift[k] = b & 7;
+#else
+        shift[k] = 1 << (7 - (b & 7));
+#endif
+    }
+#if defined(__AVX2__)
+    {
+        __m256i sh = _mm256_loadu_si256((const __m256i *)shuf);
+        __m256i cnt = _mm256_loadu_si256((const __m256i *)shift);
+        __m256i m = _mm256_set1_epi32(mask);
+        __m256i v;
+        for (; i + 8 <= n; i += 8, in += width) {
+            v = _mm256_broadcastsi128_si256(
+                                _mm_loadu_si128((const __m128i *)in));
+            v = _mm256_and_si256(
+                    _mm256_srlv_epi32(_mm256_shuffle_epi8(v, sh), cnt), m);
+            _mm_storeu_si128((__m128i *)(codes + i),
+                    _mm_packus_epi32(_mm256_castsi256_si128(v),
+                                    _mm256_extracti128_si256(v, 1)));
+        }
+    }
+#else
+    {
+        __m128i sh0 = _mm_loadu_si128((const __m128i *)shuf);
+        __m128i sh1 = _mm_loadu_si128((const __m128i *)(shuf + 16));
+        __m128i mul0 = _mm_loadu_si128((const __m128i *)shift);
+        __m128i mul1 = _mm_loadu_si128((const __m128i *)(shift + 4));
+        __m128i m = _mm_set1_epi32(mask);
+        __m128i v, lo, hi;
+        for (; i + 8 <= n; i += 8, in += width) {
+            v = _mm_loadu_si128((const __m128i *)in);
+            lo = _mm_mullo_epi32(_mm_shuffle_epi8(v, sh0), mul0);
+            hi = _mm_mullo_epi32(_mm_shuffle_epi8(v, sh1), mul1);
+            lo = _mm_and_si128(_mm_srli_epi32(lo, 7), m);
+            hi = _mm_and_si128(_mm_srli_epi32(hi, 7), m);
+            _mm_storeu_si128((__m128i *)(codes + i), _mm_packus_epi32(lo, hi));
+        }
+    }
+#endif
+#endif
+    for (k = 0; i < n; i++, k++) {
+        b = bit + k * width;
+        codes[i] = (load_le64(in + (b >> 3)) >> (b & 7)) & mask;
+    }
+}
+
+#ifdef GLZWD_COMPACT
+/* Compact layout: the head (prefix code) and tail (last byte) of each entry
+ * are in prefix[] and suffix[], 3 bytes per entry, and string lengths are
+ * not kept.  Bulk decode unwinds strings onto the stack and copies them
+ * out.  With GLZWD_OPT_BACKREF the lengths of entries in the window are
+ * kept after pos[], in the same allocation. */
+#define HEAD(st, c)     ((st)->prefix[c])
+#define TAIL(st, c)     ((st)->suffix[c])
+#define SET_ENTRY(st, c, len, head, tail) \
+    ((st)->prefix[c] = (GLZWUshort)(head), (st)->suffix[c] = (GLZWByte)(tail))
+#define CODE_LEN(st, c)  string_len(st, c)
+#define POS_SIZE        (CODE_LIMIT * (sizeof(GLZWUint) + sizeof(GLZWUshort)))
+
+static GLZWUint string_len(const Glzwd_state *st, GLZWUint c)
+{
+    GLZWUint len = 1;
+    while (c >= st->clear_code) {
+        c = st->prefix[c];
+        len++;
+    }
+    return len;
+}
+#else
+/* codes[] entries pack the string length in bits 20-31, the head (prefix
+ * code) in bits 8-19 and the tail (last byte) in bits 0-7.  Strings are
+ * at most CODE_LIMIT - 3 bytes long, so the length fits in 12 bits. */
+#define HEAD(st, c)     (((st)->codes[c] >> 8) & 0xFFF)
+#define TAIL(st, c)     ((st)->codes[c] & 0xFF)
+#define SET_ENTRY(st, c, len, head, tail) \
+    ((st)->codes[c] = (len) << 20 | (head) << 8 | (tail))
+#define CODE_LEN(st, c)  ((c) < (st)->clear_code ? 1 : (st)->codes[c] >> 20)
+#define POS_SIZE        (CODE_LIMIT * sizeof(GLZWUint))
+#endif
+
 static void glzwd_reset(Glzwd_state *st)
 {
     st->next_code = st->end_code + 1;
@@ -44,29 +173,525 @@ int glzwd_init(void **pstate, const GLZWUint lzw_min_code_width)
     return GLZW_OK;
 }
 
+/* Bulk decode, used when the output buffer has room for the longest
+ * possible string and the input has at least BULK_MIN_IN bytes.  While that
+ * holds, none of the per-byte checks needed for resuming are required, so
+ * the decoder state is kept in locals and each string is written directly
+ * to the output, back to front, without going through the stack (with
+ * GLZWD_COMPACT, which has no lengths, via the stack and memcpy).  Returns
+ * BULK_EDGE near the end of either buffer, with the state saved so the
+ * resumable code can carry on at get_code.
+ *
+ * Codes are taken from a 64-bit bit buffer refilled with one 8-byte load,
+ * keeping as many whole bytes as fit; the bits above those are the start
+ * of the next byte, so OR-ing in the next load over them is harmless.  On
+ * leaving, whole bytes still in the buffer are handed back to the input,
+ * and the 0-7 bits left over go to code_buffer as the byte-at-a-time code
+ * expects.
+ *
+ * The width only changes after max_code + 1 - next_code more codes (never
+ * once the table is full) or at a CLEAR, so when that run is long enough
+ * the codes are unpacked BATCH_SIZE at a time into cbuf[] by
+ * unpack_codes() and the bit buffer is moved past them.  A CLEAR or END in
+ * the batch moves it back to just after that code.
+ *
+ * With GLZWD_OPT_BACKREF, the output is also used as the dictionary, as in
+ * an LZ77 decoder: pos[] records where each entry's string first appears,
+ * and a later code for it is a single copy from there.  An entry's string
+ * is the previous string plus one byte, so it starts where the previous
+ * string was written.  Positions are only known for entries created in
+ * this run, since earlier output may no longer be in the caller's buffer;
+ * codes below win_floor still unwind through the table.
+ *
+ * With GLZWD_OPT_SLACK, the caller allows writing a few bytes past the end
+ * of the output, so a string of up to INLINE_LEN bytes is written with one
+ * INLINE_LEN-byte copy from inl[], which holds the first INLINE_LEN bytes
+ * of each entry's string.  The loop then runs until the output is nearly
+ * full rather than stopping STACK_SIZE bytes short of the end; a string
+ * that does not fit is left to the resumable code, returning BULK_CODE
+ * with the code in st->code.
+ *
+ * Once the table is full, it stays as it is and the width stays at 12 until
+ * a CLEAR, which an encoder may put off indefinitely.  Batches are then
+ * decoded by a separate loop with no insert or width logic.  With
+ * GLZWD_OPT_BACKREF, that loop also records where each code's string was
+ * last written, marking it in seen[], so the next use is a copy.
+ */
+static int glzwd_bulk(Glzwd_state *st, const GLZWByte **pin, GLZWByte **pout,
+        GLZWUint *in_avail, GLZWUint *out_avail)
+{
+    const GLZWByte *in_ptr = *pin, *in_start = *pin, *in_end = *pin + *in_avail;
+    /* End of the current sub-block's data in this call's input, and how
+     * much of it lies beyond; without GLZWD_OPT_SUBBLOCKS, all the input. */
+    const GLZWByte *blk_end = in_end;
+    GLZWUint blk_rest = 0;
+    const GLZWByte *batch_ptr = NULL, *q;
+    GLZWByte *out_ptr = *pout, *out_base = *pout, *p;
+    GLZWUint out_left = *out_avail;
+    Bitbuf code_buffer = st->code_buffer & ((1 << st->bits_in_buf) - 1);
+    GLZWUint bits_in_buf = st->bits_in_buf, n, bit;
+    GLZWUshort cbuf[BATCH_SIZE];
+    GLZWUint ci = 0, nc = 0, batch_bit = 0;
+    GLZWUint clear_code = st->clear_code, end_code = st->end_code;
+    GLZWUint next_code = st->next_code, max_code = st->max_code;
+    GLZWUint code_width = st->code_width;
+    GLZWUint prev_code = st->prev_code, first_byte = st->first_byte;
+    GLZWUint prev_len = 0, prev_pos = 0, len, code, c, i;
+    GLZWUint initial = st->control_state == ST_INITIAL;
+    GLZWUint *pos = st->pos;
+    GLZWByte *inl = st->inl;
+#ifndef GLZWD_COMPACT
+    GLZWByte seen[CODE_LIMIT / 8];
+    GLZWUint seen_clear = 0;
+#endif
+    /* A string is at most STACK_SIZE bytes. */
+    GLZWUint min_out = inl ? 1 : STACK_SIZE;
+#ifdef GLZWD_COMPACT
+    GLZWUshort *lens = pos ? (GLZWUshort *)(pos + CODE_LIMIT) : NULL;
+    GLZWByte *stack_end = st->stack + STACK_SIZE;
+#endif
+    /* The first entry made here extends a string written before entry. */
+    GLZWUint win_floor = pos ? next_code + 1 : CODE_LIMIT;
+    int r = BULK_EDGE;
+
+    if (st->sb_on) {
+        n = *in_avail < st->sb_left ? *in_avail : st->sb_left;
+        blk_end = in_ptr + n;
+        blk_rest = st->sb_left - n;
+    }
+
+/* Move the bit buffer to nbits past byte pointer p. */
+#define SEEK_BITS(p, nbits) \
+    do { \
+        in_ptr = (p) + ((nbits) >> 3); \
+        bits_in_buf = 0; \
+        code_buffer = 0; \
+        if ((nbits) & 7) { \
+            bits_in_buf = 8 - ((nbits) & 7); \
+            code_buffer = *in_ptr++ >> ((nbits) & 7); \
+        } \
+    } while (0)
+
+    if (!initial)
+        prev_len = CODE_LEN(st, prev_code);
+    while (out_left >= min_out) {
+#ifndef GLZWD_COMPACT
+        if (ci < nc && next_code == CODE_LIMIT) {
+            if (pos && !seen_clear) {
+                memset(seen, 0, sizeof(seen));
+                seen_clear = 1;
+            }
+            /* Leave a CLEAR or END, or a string that does not fit, to the
+             * code below. */
+            while (ci < nc) {
+                code = cbuf[ci];
+                if (code < clear_code) {
+                    if (!out_left)
+                        break;
+                    first_byte = prev_code = code;
+                    prev_len = 1;
+                    prev_pos = out_ptr - out_base;
+                    *out_ptr++ = (GLZWByte)code;
+                    out_left--;
+                    ci++;
+                    continue;
+                }
+                if (code <= end_code)
+                    break;
+                len = CODE_LEN(st, code);
+                if (len > out_left)
+                    break;
+                if (inl && len <= INLINE_LEN) {
+                    memcpy(out_ptr, inl + code * INLINE_LEN, INLINE_LEN);
+                } else if (pos && (code >= win_floor ||
+                                seen[code >> 3] & (1 << (code & 7)))) {
+                    memcpy(out_ptr, out_base + pos[code], len);
+                } else {
+                    p = out_ptr + len;
+                    for (c = code; c >= clear_code; c = HEAD(st, c))
+                        *--p = TAIL(st, c);
+                    *--p = c;
+                }
+                if (pos) {
+                    pos[code] = out_ptr - out_base;
+                    seen[code >> 3] |= 1 << (code & 7);
+                }
+                prev_code = code;
+                prev_len = len;
+                prev_pos = out_ptr - out_base;
+                first_byte = *out_ptr;
+                out_ptr += len;
+                out_left -= len;
+                ci++;
+            }
+            if (ci == nc)
+                continue;
+            /* The output is full: leave the rest to the resumable code. */
+            if (!out_left)
+                break;
+        }
+#endif
+        if (ci < nc) {
+            code = cbuf[ci++];
+            goto got_code;
+        }
+        nc = ci = 0;
+        /* Start of the next code; a batch can only use this call's input. */
+        q = in_ptr - ((bits_in_buf + 7) >> 3);
+        bit = (8 - (bits_in_buf & 7)) & 7;
+        n = next_code < CODE_LIMIT ? max_code + 1 - next_code : BATCH_SIZE;
+        if (n > BATCH_SIZE)
+            n = BATCH_SIZE;
+        /* Fewer near the end of the input or of a sub-block: only codes
+         * wholly before blk_end, with UNPACK_SLACK more bytes of input. */
+        if (q >= in_start) {
+            len = in_end - q < UNPACK_SLACK ? 0 : in_end - q - UNPACK_SLACK;
+            if (len > (GLZWUint)(blk_end - q))
+                len = blk_end - q;
+            len = len * 8 > bit ? (len * 8 - bit) / code_width : 0;
+            if (n > len)
+                n = len;
+        }
+        if (n >= BATCH_MIN && q >= in_start) {
+            unpack_codes(q, bit, code_width, n, cbuf);
+            batch_ptr = q;
+            batch_bit = bit;
+            nc = n;
+            SEEK_BITS(batch_ptr, batch_bit + nc * code_width);
+            code = cbuf[ci++];
+            goto got_code;
+        }
+        if (bits_in_buf < code_width && blk_end - in_ptr >= BULK_MIN_IN) {
+            code_buffer |= load_le64(in_ptr) << bits_in_buf;
+            n = (63 - bits_in_buf) >> 3;
+            in_ptr += n;
+            bits_in_buf += n << 3;
+        } else if (bits_in_buf < code_width) {
+            if (!st->sb_on)
+                break;
+            /* Near the end of a sub-block: a byte at a time, stepping over
+             * the next count byte if it is in this call's input.  The
+             * bytes left above bits_in_buf by the last 8-byte load are all
+             * before blk_end, so are the ones read here. */
+            while (bits_in_buf < code_width) {
+                if (in_ptr == blk_end) {
+                    if (blk_rest || blk_end == in_end || !*blk_end ||
+                                                            st->sb_end)
+                        break;
+                    in_start = blk_end + 1;
+                    n = in_end - in_start;
+                    if (n > *blk_end)
+                        n = *blk_end;
+                    blk_rest = *blk_end - n;
+                    in_ptr = in_start;
+                    blk_end = in_start + n;
+                    continue;
+                }
+                code_buffer |= (Bitbuf)*in_ptr++ << bits_in_buf;
+                bits_in_buf += 8;
+            }
+            if (bits_in_buf < code_width)
+                break;
+        }
+        code = code_buffer & ((1 << code_width) - 1);
+        code_buffer >>= code_width;
+        bits_in_buf -= code_width;
+got_code:
+#ifdef TESTDEV
+if (print_dec_codes) printf("dec code: %d\n", code);
+#endif
+        if (ci < nc && (code == end_code || code == clear_code)) {
+            SEEK_BITS(batch_ptr, batch_bit + ci * code_width);
+            nc = ci = 0;
+        }
+        if (code == end_code) {
+            r = BULK_END;
+            break;
+        }
+        if (code == clear_code) {
+            next_code = end_code + 1;
+            max_code = 2 * clear_code - 1;
+            code_width = st->lzw_min_code_width + 1;
+            initial = 1;
+            if (pos)
+                win_floor = next_code;
+#ifndef GLZWD_COMPACT
+            seen_clear = 0;
+#endif
+            continue;
+        }
+        if (initial) {
+            first_byte = prev_code = code;
+            if (code > end_code) {
+                r = BULK_INVALID;
+                break;
+            }
+            prev_pos = out_ptr - out_base;
+            *out_ptr++ = code;
+            out_left--;
+            prev_len = 1;
+            initial = 0;
+            continue;
+        }
+        /* A run of literals after a literal, as in streams written without
+         * compression: the bytes are copied straight out, and each makes
+         * an entry of the byte before it plus itself, length 2.  A batch
+         * ends before the width can change, so it is checked once.  There
+         * must be room for at least the first byte. */
+        if (code < clear_code && prev_len == 1 && nc && out_left) {
+            const GLZWUshort *run = cbuf + ci - 1;
+            n = nc - ci + 1;
+            if (n > out_left)
+                n = out_left;
+            for (len = 1; len < n && run[len] < clear_code; len++)
+                ;
+            ci += len - 1;
+            for (i = 0; i < len; i++)
+                out_ptr[i] = (GLZWByte)run[i];
+            n = CODE_LIMIT - next_code;
+            if (n > len)
+                n = len;
+            if (n) {
+                for (c = prev_code, i = 0; i < n; c = run[i++])
+                    SET_ENTRY(st, next_code + i, 2, c, run[i]);
+                if (pos) {
+                    pos[next_code] = prev_pos;
+                    for (i = 1; i < n; i++)
+                        pos[next_code + i] = out_ptr - out_base + i - 1;
+#ifdef GLZWD_COMPACT
+                    for (i = 0; i < n; i++)
+                        lens[next_code + i] = 2;
+#endif
+                }
+                if (inl) {
+                    for (c = prev_code, i = 0; i < n; c = run[i++]) {
+                        inl[(next_code + i) * INLINE_LEN] = (GLZWByte)c;
+                        inl[(next_code + i) * INLINE_LEN + 1] = (GLZWByte)run[i];
+                    }
+                }
+                next_code += n;
+                if (next_code > max_code && next_code < CODE_LIMIT) {
+                    max_code = max_code * 2 + 1;
+                    code_width++;
+                }
+            }
+            first_byte = prev_code = run[len - 1];
+            prev_pos = out_ptr - out_base + len - 1;
+            out_ptr += len;
+            out_left -= len;
+            continue;
+        }
+#ifdef GLZWD_COMPACT
+        /* Copy the string from earlier output if it is there, otherwise
+         * unwind it onto the stack and copy it out. */
+        if (code < next_code) {
+            if (code >= win_floor) {
+                len = lens[code];
+                memcpy(out_ptr, out_base + pos[code], len);
+                first_byte = *out_ptr;
+                goto insert;
+            }
+            c = code;
+            p = stack_end;
+        } else if (code == next_code) {
+            /* KwKwK: previous string plus its own first byte. */
+            if (pos && (GLZWUint)(out_ptr - out_base) >= prev_len) {
+                len = prev_len + 1;
+                out_ptr[prev_len] = first_byte;
+                memcpy(out_ptr, out_ptr - prev_len, prev_len);
+                goto insert;
+            }
+            c = prev_code;
+            p = stack_end;
+            *--p = first_byte;
+        } else {
+            r = BULK_INVALID;
+            break;
+        }
+        while (c >= clear_code) {
+            *--p = TAIL(st, c);
+            c = HEAD(st, c);
+        }
+        *--p = first_byte = c;
+        len = stack_end - p;
+        memcpy(out_ptr, p, len);
+#else
+        if (code < next_code) {
+            len = CODE_LEN(st, code);
+            c = code;
+        } else if (code == next_code) {
+            /* KwKwK: previous string plus its own first byte. */
+            len = prev_len + 1;
+            c = prev_code;
+        } else {
+            r = BULK_INVALID;
+            break;
+        }
+        if (len > out_left) {
+            st->code = code;
+            r = BULK_CODE;
+            break;
+        }
+        if (inl && len <= INLINE_LEN) {
+            memcpy(out_ptr, inl + c * INLINE_LEN, INLINE_LEN);
+            if (c != code)
+                out_ptr[prev_len] = first_byte;
+            first_byte = *out_ptr;
+            goto insert;
+        }
+        /* Copy the string from earlier output if it is there, otherwise
+         * write it back to front. */
+        if (c == code) {
+            if (code >= win_floor) {
+                memcpy(out_ptr, out_base + pos[code], len);
+                first_byte = *out_ptr;
+                goto insert;
+            }
+            p = out_ptr + len;
+        } else {
+            out_ptr[prev_len] = first_byte;
+            if (pos && (GLZWUint)(out_ptr - out_base) >= prev_len) {
+                memcpy(out_ptr, out_ptr - prev_len, prev_len);
+                goto insert;
+            }
+            p = out_ptr + prev_len;
+        }
+        while (c >= clear_code) {
+            *--p = TAIL(st, c);
+            c = HEAD(st, c);
+        }
+        *--p = first_byte = c;
+#endif
+
+insert:
+        if (next_code < CODE_LIMIT) {
+            if (pos) {
+                pos[next_code] = prev_pos;
+#ifdef GLZWD_COMPACT
+                lens[next_code] = (GLZWUshort)(prev_len + 1);
+#endif
+            }
+            if (inl && prev_len < INLINE_LEN) {
+                GLZWByte *e = inl + next_code * INLINE_LEN;
+                memcpy(e, inl + prev_code * INLINE_LEN, INLINE_LEN);
+                e[prev_len] = first_byte;
+            }
+            SET_ENTRY(st, next_code, prev_len + 1, prev_code, first_byte);
+            next_code++;
+            if (next_code > max_code && next_code < CODE_LIMIT) {
+                max_code = max_code * 2 + 1;
+                code_width++;
+            }
+        }
+        prev_code = code;
+        prev_len = len;
+        prev_pos = out_ptr - out_base;
+        out_ptr += len;
+        out_left -= len;
+    }
+    if (ci < nc)
+        SEEK_BITS(batch_ptr, batch_bit + ci * code_width);
+#undef SEEK_BITS
+    n = bits_in_buf >> 3;
+    /* Whole bytes read before a count byte cannot be handed back; they are
+     * kept in code_buffer instead, which then holds fewer than code_width
+     * bits. */
+    if (in_ptr - n < in_start)
+        n = 0;
+    *pin = in_ptr - n;
+    *pout = out_ptr;
+    *in_avail = in_end - *pin;
+    *out_avail = out_left;
+    if (st->sb_on)
+        st->sb_left = blk_end - *pin + blk_rest;
+    st->bits_in_buf = bits_in_buf - (n << 3);
+    st->code_buffer = code_buffer & ((1 << st->bits_in_buf) - 1);
+    st->next_code = next_code;
+    st->max_code = max_code;
+    st->code_width = code_width;
+    st->prev_code = prev_code;
+    st->first_byte = first_byte;
+    st->control_state = initial ? ST_INITIAL : ST_NORMAL;
+    return r;
+}
+
+/* Check there is an input byte to read.  With GLZWD_OPT_SUBBLOCKS, first
+ * read count bytes until in a sub-block with data left, and count the byte
+ * as read from it.  Returns GLZW_OK, GLZW_NO_INPUT_AVAIL, or
+ * GLZW_INVALID_DATA at the block terminator.
+ */
+static int next_byte(Glzwd_state *st, const GLZWByte **pin,
+        GLZWUint *in_avail)
+{
+    if (st->sb_on) {
+        while (!st->sb_left) {
+            if (st->sb_end)
+                return GLZW_INVALID_DATA;
+            if (!*in_avail)
+                return GLZW_NO_INPUT_AVAIL;
+            st->sb_left = *(*pin)++;
+            (*in_avail)--;
+            st->sb_end = !st->sb_left;
+        }
+        if (*in_avail)
+            st->sb_left--;
+    }
+    return *in_avail ? GLZW_OK : GLZW_NO_INPUT_AVAIL;
+}
+
 int glzwd(void *state, const GLZWByte *in_ptr, GLZWByte *out_ptr,
         GLZWUint *in_avail, GLZWUint *out_avail)
 {
     Glzwd_state *st = (Glzwd_state *)state;
+    GLZWUint n;
+    int r;
+    /* GLZWD_OPT_SKIP_BITS: discard input before the first code. */
+    while (st->skip_bits) {
+        r = next_byte(st, &in_ptr, in_avail);
+        if (r)
+            return r;
+        if (st->skip_bits >= 8) {
+            st->skip_bits -= 8;
+        } else {
+            st->code_buffer = *in_ptr >> st->skip_bits;
+            st->bits_in_buf = 8 - st->skip_bits;
+            st->skip_bits = 0;
+        }
+        in_ptr++;
+        (*in_avail)--;
+    }
     switch (st->resume_state) {
 
     case LZW_INITIAL:
 get_code:
+        if (*in_avail >= BULK_MIN_IN &&
+                        *out_avail >= (st->inl ? 1 : STACK_SIZE)) {
+            r = glzwd_bulk(st, &in_ptr, &out_ptr, in_avail, out_avail);
+            if (r == BULK_END) {
+                st->resume_state = LZW_FINISHED;
+                goto finished;
+            }
+            if (r == BULK_INVALID)
+                return GLZW_INVALID_DATA;
+            if (r == BULK_CODE)
+                goto got_code;
+        }
         st->code_bits_needed = st->code_width;
         st->code = 0;
         while (st->code_bits_needed) {
             if (!st->bits_in_buf) {
 
     case LZW_TRY_IN:
-                if (!*in_avail) {
+                r = next_byte(st, &in_ptr, in_avail);
+                if (r) {
                     st->resume_state = LZW_TRY_IN;
-                    return GLZW_NO_INPUT_AVAIL;
+                    return r;
                 }
                 st->code_buffer = *in_ptr++;
                 (*in_avail)--;
                 st->bits_in_buf = 8;
             }
-            GLZWUint n = st->bits_in_buf < st->code_bits_needed ?
+            n = st->bits_in_buf < st->code_bits_needed ?
                                     st->bits_in_buf : st->code_bits_needed;
             st->code |= (st->code_buffer & ((1 << n) - 1)) <<
                                     (st->code_width - st->code_bits_needed);
@@ -79,9 +704,10 @@ get_code:
 #ifdef TESTDEV
 if (print_dec_codes) printf("dec code: %d\n", st->code);
 #endif
+got_code:
         if (st->code == st->end_code) {
             st->resume_state = LZW_FINISHED;
-            return GLZW_OK;
+            goto finished;
         }
         if (st->code == st->clear_code) {
             glzwd_reset(st);
@@ -112,16 +738,13 @@ if (print_dec_codes) printf("dec code: %d\n", st->code);
         }
         /* "Unwind" code's string to stack */
         while (st->code >= st->clear_code) {
-            /* heads are packed to left of tails in codes */
-            /* tails */
-            *st->stack_ptr++ = st->codes[st->code] & 0xFF;
-            /* heads */
-            st->code = (st->codes[st->code] >> 8) & 0xFFF;
+            *st->stack_ptr++ = TAIL(st, st->code);
+            st->code = HEAD(st, st->code);
         }
         *st->stack_ptr++ = st->first_byte = st->code;
 
-        /* TODO: Here we may be able to run faster by checking for
-         * and only moving as many bytes as we have room for.
+        /* Only reached near the end of the output buffer; otherwise
+         * glzwd_bulk() writes strings straight to the output.
          */
         do {
 
@@ -135,9 +758,16 @@ if (print_dec_codes) printf("dec code: %d\n", st->code);
         } while (st->stack_ptr > st->stack);
 
         if (st->next_code < CODE_LIMIT) {
-            /* heads are packed to left of tails in codes */
-            st->codes[st->next_code++] =
-                                        (st->prev_code << 8) | st->code;
+#ifndef GLZWD_COMPACT
+            if (st->inl && CODE_LEN(st, st->prev_code) < INLINE_LEN) {
+                GLZWByte *e = st->inl + st->next_code * INLINE_LEN;
+                memcpy(e, st->inl + st->prev_code * INLINE_LEN, INLINE_LEN);
+                e[CODE_LEN(st, st->prev_code)] = st->code;
+            }
+#endif
+            SET_ENTRY(st, st->next_code, CODE_LEN(st, st->prev_code) + 1,
+                                                st->prev_code, st->code);
+            st->next_code++;
             if (st->next_code > st->max_code && st->next_code < CODE_LIMIT) {
                 st->max_code = st->max_code * 2 + 1;
                 st->code_width++;
@@ -147,6 +777,23 @@ if (print_dec_codes) printf("dec code: %d\n", st->code);
         goto get_code;
 
     case LZW_FINISHED:
+finished:
+        /* GLZWD_OPT_SUBBLOCKS: skip anything after END, up to and
+         * including the block terminator. */
+        while (st->sb_on && !st->sb_end) {
+            if (!*in_avail)
+                return GLZW_NO_INPUT_AVAIL;
+            if (st->sb_left) {
+                n = *in_avail < st->sb_left ? *in_avail : st->sb_left;
+                in_ptr += n;
+                *in_avail -= n;
+                st->sb_left -= n;
+            } else {
+                st->sb_left = *in_ptr++;
+                (*in_avail)--;
+                st->sb_end = !st->sb_left;
+            }
+        }
         return GLZW_OK;
 
     default:
@@ -154,7 +801,272 @@ if (print_dec_codes) printf("dec code: %d\n", st->code);
     }
 }
 
+/* Split a complete LZW stream into its codes, without decoding them.
+ * This is the bit-unpacking half of glzwd() on its own, tracking only the
+ * code width.
+ */
+int glzwd_unpack(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWUshort *codes, GLZWUint *ncodes)
+{
+    const GLZWByte *in_end = in_ptr + in_avail;
+    GLZWUint clear_code = 1 << lzw_min_code_width;
+    GLZWUint end_code = clear_code + 1;
+    GLZWUint next_code = end_code + 1, max_code = 2 * clear_code - 1;
+    GLZWUint code_width = lzw_min_code_width + 1, width;
+    GLZWUint bit = 0, initial = 1, count = 0, i, n, v, code;
+    int r = GLZW_NO_OUTPUT_AVAIL;
+
+    while (count < *ncodes) {
+        /* Unpack as many codes as are sure to have the same width. */
+        n = next_code < CODE_LIMIT ? max_code + 1 - next_code : BATCH_SIZE;
+        if (n > BATCH_SIZE)
+            n = BATCH_SIZE;
+        if (n > *ncodes - count)
+            n = *ncodes - count;
+        if ((GLZWUint)(in_end - in_ptr) >=
+                        (bit + n * code_width + 7) / 8 + UNPACK_SLACK) {
+            unpack_codes(in_ptr, bit, code_width, n, codes + count);
+        } else {
+            /* Near the end of the input, one code at a time. */
+            n = 1;
+            if ((GLZWUint)(in_end - in_ptr) < (bit + code_width + 7) / 8) {
+                r = GLZW_NO_INPUT_AVAIL;
+                break;
+            }
+            v = 0;
+            for (i = 0; i < 3 && in_ptr + i < in_end; i++)
+                v |= in_ptr[i] << (8 * i);
+            codes[count] = (v >> bit) & ((1 << code_width) - 1);
+        }
+        width = code_width;
+        for (i = 0; i < n; ) {
+            code = codes[count + i++];
+            if (code == end_code) {
+                r = GLZW_OK;
+                break;
+            }
+            if (code == clear_code) {
+                next_code = end_code + 1;
+                max_code = 2 * clear_code - 1;
+                code_width = lzw_min_code_width + 1;
+                initial = 1;
+                break;
+            }
+            if (initial) {
+                if (code > end_code) {
+                    r = GLZW_INVALID_DATA;
+                    break;
+                }
+                initial = 0;
+            } else if (code > next_code) {
+                r = GLZW_INVALID_DATA;
+                break;
+            } else if (next_code < CODE_LIMIT) {
+                next_code++;
+                if (next_code > max_code && next_code < CODE_LIMIT) {
+                    max_code = max_code * 2 + 1;
+                    code_width++;
+                }
+            }
+        }
+        if (r == GLZW_INVALID_DATA) {
+            count += i - 1;
+            break;
+        }
+        count += i;
+        if (r == GLZW_OK)
+            break;
+        bit += i * width;
+        in_ptr += bit >> 3;
+        bit &= 7;
+    }
+    *ncodes = count;
+    return r;
+}
+
+/* Walk a complete LZW stream without writing output, keeping only the
+ * length of each table entry's string.  Used by glzwd_scan() and
+ * glzwd_validate(); fn may be NULL. */
+static int scan_stream(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, Glzwd_scan_fn fn, void *arg,
+        Glzwd_stats *stats)
+{
+    const GLZWByte *in_start = in_ptr, *in_end = in_ptr + in_avail;
+    GLZWUshort cbuf[BATCH_SIZE], lens[CODE_LIMIT];
+    GLZWUint clear_code = 1 << lzw_min_code_width;
+    GLZWUint end_code = clear_code + 1;
+    GLZWUint next_code = end_code + 1, max_code = 2 * clear_code - 1;
+    GLZWUint code_width = lzw_min_code_width + 1, width;
+    GLZWUint bit = 0, initial = 1, out_off = 0, i, n, v, code = 0, prev = 0;
+    GLZWUint nclears = 0, ncodes = 0;
+    int r = GLZW_NO_INPUT_AVAIL;
+
+    for (i = 0; i < clear_code; i++)
+        lens[i] = 1;
+    for (;;) {
+        /* Unpack as many codes as are sure to have the same width. */
+        n = next_code < CODE_LIMIT ? max_code + 1 - next_code : BATCH_SIZE;
+        if (n > BATCH_SIZE)
+            n = BATCH_SIZE;
+        if ((GLZWUint)(in_end - in_ptr) >=
+                        (bit + n * code_width + 7) / 8 + UNPACK_SLACK) {
+            unpack_codes(in_ptr, bit, code_width, n, cbuf);
+        } else {
+            /* Near the end of the input, one code at a time. */
+            n = 1;
+            if ((GLZWUint)(in_end - in_ptr) < (bit + code_width + 7) / 8)
+                break;
+            v = 0;
+            for (i = 0; i < 3 && in_ptr + i < in_end; i++)
+                v |= in_ptr[i] << (8 * i);
+            cbuf[0] = (v >> bit) & ((1 << code_width) - 1);
+        }
+        width = code_width;
+        for (i = 0; i < n; ) {
+            code = cbuf[i++];
+            if (code == end_code) {
+                r = GLZW_OK;
+                break;
+            }
+            if (code == clear_code) {
+                nclears++;
+                next_code = end_code + 1;
+                max_code = 2 * clear_code - 1;
+                code_width = lzw_min_code_width + 1;
+                initial = 1;
+                break;
+            }
+            if (initial) {
+                if (code > end_code) {
+                    r = GLZW_INVALID_DATA;
+                    break;
+                }
+                out_off++;
+                initial = 0;
+            } else if (code > next_code) {
+                r = GLZW_INVALID_DATA;
+                break;
+            } else {
+                out_off += code == next_code ? lens[prev] + 1 : lens[code];
+                if (next_code < CODE_LIMIT) {
+                    lens[next_code++] = lens[prev] + 1;
+                    if (next_code > max_code && next_code < CODE_LIMIT) {
+                        max_code = max_code * 2 + 1;
+                        code_width++;
+                    }
+                }
+            }
+            prev = code;
+        }
+        ncodes += i;
+        bit += i * width;
+        in_ptr += bit >> 3;
+        bit &= 7;
+        if (r != GLZW_NO_INPUT_AVAIL)
+            break;
+        if (code == clear_code && fn) {
+            r = fn(arg, (in_ptr - in_start) * 8 + bit, out_off);
+            if (r)
+                break;
+            r = GLZW_NO_INPUT_AVAIL;
+        }
+    }
+    stats->out_size = out_off;
+    stats->nclears = nclears;
+    stats->ncodes = ncodes;
+    stats->in_bit = (in_ptr - in_start) * 8 + bit;
+    /* Point at the invalid code, not after it. */
+    if (r == GLZW_INVALID_DATA) {
+        stats->ncodes--;
+        stats->in_bit -= width;
+    }
+    return r;
+}
+
+/* Find the CLEAR codes in a complete LZW stream, and the length of the
+ * output, without decoding it.  fn(arg, in_bit, out_off) is called after
+ * each CLEAR, with the bit offset of the code after it and the output
+ * length so far; if fn returns nonzero, the scan stops and returns that
+ * value.  Since a CLEAR resets the decoder, a decoder started at in_bit
+ * (see GLZWD_OPT_SKIP_BITS) produces the output from out_off on.
+ */
+int glzwd_scan(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, Glzwd_scan_fn fn, void *arg,
+        GLZWUint *out_size)
+{
+    Glzwd_stats stats;
+    int r = scan_stream(in_ptr, in_avail, lzw_min_code_width, fn, arg,
+                                                                &stats);
+    *out_size = stats.out_size;
+    return r;
+}
+
+/* Check a complete LZW stream without decoding it, and report the output
+ * length, the number of codes and CLEAR codes, and where it stopped. */
+int glzwd_validate(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, Glzwd_stats *stats)
+{
+    return scan_stream(in_ptr, in_avail, lzw_min_code_width, NULL, NULL,
+                                                                stats);
+}
+
+int glzwd_set_option(void *state, GLZWUint option, GLZWUint value)
+{
+    Glzwd_state *st = (Glzwd_state *)state;
+    switch (option) {
+    case GLZWD_OPT_BACKREF:
+        if (value && !st->pos) {
+            st->pos = (GLZWUint *)malloc(POS_SIZE);
+            if (!st->pos)
+                return GLZW_OUT_OF_MEMORY;
+        } else if (!value) {
+            free(st->pos);
+            st->pos = NULL;
+        }
+        return GLZW_OK;
+    case GLZWD_OPT_SLACK:
+#ifdef GLZWD_COMPACT
+        /* Not supported: the compact table has no string lengths. */
+        return value ? GLZW_INVALID_OPTION : GLZW_OK;
+#else
+        if (value && value < INLINE_LEN)
+            return GLZW_INVALID_OPTION;
+        if (value && !st->inl) {
+            GLZWUint c;
+            st->inl = (GLZWByte *)malloc(CODE_LIMIT * INLINE_LEN);
+            if (!st->inl)
+                return GLZW_OUT_OF_MEMORY;
+            for (c = 0; c < st->clear_code; c++)
+                st->inl[c * INLINE_LEN] = c;
+            /* Fill in entries already in the table, each from its head. */
+            for (c = st->end_code + 1; c < st->next_code; c++) {
+                if (CODE_LEN(st, c) <= INLINE_LEN) {
+                    memcpy(st->inl + c * INLINE_LEN,
+                            st->inl + HEAD(st, c) * INLINE_LEN, INLINE_LEN);
+                    st->inl[c * INLINE_LEN + CODE_LEN(st, c) - 1] = TAIL(st, c);
+                }
+            }
+        } else if (!value) {
+            free(st->inl);
+            st->inl = NULL;
+        }
+        return GLZW_OK;
+#endif
+    case GLZWD_OPT_SKIP_BITS:
+        st->skip_bits = value;
+        return GLZW_OK;
+    case GLZWD_OPT_SUBBLOCKS:
+        st->sb_on = value != 0;
+        return GLZW_OK;
+    default:
+        return GLZW_INVALID_OPTION;
+    }
+}
+
 void glzwd_end(void *state)
 {
+    Glzwd_state *st = (Glzwd_state *)state;
+    free(st->pos);
+    free(st->inl);
     free(state);
 }
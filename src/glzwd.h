@@ -4,6 +4,7 @@
 
 typedef unsigned char GLZWByte;
 typedef unsigned int GLZWUint;
+typedef unsigned short GLZWUshort;
 
 /* Return values */
 #define GLZW_OK                 0
@@ -12,6 +13,13 @@ typedef unsigned int GLZWUint;
 #define GLZW_OUT_OF_MEMORY      3
 #define GLZW_INTERNAL_ERROR     4
 #define GLZW_INVALID_DATA       5
+#define GLZW_INVALID_OPTION     6
+
+/* Options for glzwd_set_option() */
+#define GLZWD_OPT_BACKREF       1
+#define GLZWD_OPT_SLACK         2
+#define GLZWD_OPT_SKIP_BITS     3
+#define GLZWD_OPT_SUBBLOCKS     4
 
 #define CODE_LIMIT              4096
 #define STACK_SIZE              4096
@@ -24,13 +32,50 @@ typedef struct Glzwd_state {
     GLZWUint code_width, code_bits_needed, bits_in_buf;
     GLZWUint code_buffer, first_byte;
     GLZWUint code, in_code, prev_code;
+#ifdef GLZWD_COMPACT
+    /* Prefix and suffix in separate arrays, without string lengths. */
+    GLZWUshort prefix[CODE_LIMIT];
+    GLZWByte suffix[CODE_LIMIT];
+#else
     GLZWUint codes[CODE_LIMIT];
+#endif
     GLZWByte stack[STACK_SIZE], *stack_ptr;
+    GLZWUint *pos;
+    GLZWByte *inl;
+    GLZWUint skip_bits;
+    /* With GLZWD_OPT_SUBBLOCKS: data bytes left in the current sub-block,
+     * and whether the block terminator has been read. */
+    GLZWUint sb_on, sb_left, sb_end;
 } Glzwd_state;
 
+/* Results of glzwd_validate(). */
+typedef struct Glzwd_stats {
+    GLZWUint out_size;      /* bytes the stream decodes to */
+    GLZWUint ncodes;        /* codes read, including CLEAR and END */
+    GLZWUint nclears;       /* CLEAR codes */
+    GLZWUint in_bit;        /* bit offset after END, after the last whole
+                             * code if the input ran out, or of the
+                             * invalid code */
+} Glzwd_stats;
+
+/* Called by glzwd_scan() after each CLEAR code. */
+typedef int (*Glzwd_scan_fn)(void *arg, GLZWUint in_bit, GLZWUint out_off);
+
 int glzwd_init(void **pstate, const GLZWUint lzw_min_code_width);
 
 int glzwd(void *state, const GLZWByte *in_ptr, GLZWByte *out_ptr,
         GLZWUint *in_avail, GLZWUint *out_avail);
 
+int glzwd_unpack(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWUshort *codes, GLZWUint *ncodes);
+
+int glzwd_scan(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, Glzwd_scan_fn fn, void *arg,
+        GLZWUint *out_size);
+
+int glzwd_validate(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, Glzwd_stats *stats);
+
+int glzwd_set_option(void *state, GLZWUint option, GLZWUint value);
+
 void glzwd_end(void *state);
@@ -0,0 +1,345 @@
+/* glzwdp.c -- GIF LZW two-phase (parallel) decoder
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+/* stdlib.h for malloc()/free(); limits.h for UINT_MAX. */
+#include <stdlib.h>
+#include <limits.h>
+
+#include "glzwd.h"
+#include "glzwdp.h"
+#define GLZW_RUN_JOBS
+#include "glzwint.h"
+
+/* Codes between checkpoints. */
+#define CHECK_CODES     4096
+
+/* Decoder state at the start of every CHECK_CODES codes, from which the
+ * codes that follow can be expanded without looking at earlier ones. */
+typedef struct Checkpoint {
+    GLZWUint index;         /* index in codes[] */
+    GLZWUint out_off;       /* output offset */
+    GLZWUint base;          /* ents[] index of the segment's first entry */
+    GLZWUint next_code;
+    GLZWUint initial;
+} Checkpoint;
+
+typedef struct Expand_job {
+    const GLZWUshort *codes;
+    const GLZWUint *ents;
+    const Checkpoint *ck;   /* where to start */
+    GLZWUint end_index;     /* codes[] index to stop at */
+    GLZWUint clear_code;
+    GLZWByte *out;
+} Expand_job;
+
+/* A run of segments for glzwdp_split(), decoded by its own glzwd state. */
+typedef struct Split_job {
+    const GLZWByte *in_ptr;
+    GLZWUint in_avail, lzw_min_code_width;
+    GLZWUint in_bit;        /* bits to skip in in_ptr[0] */
+    GLZWByte *out_ptr;      /* where the first segment's output goes */
+    GLZWUint out_len;       /* output for the whole run */
+    int ret;
+} Split_job;
+
+/* Where each segment starts, as found by glzwd_scan(). */
+typedef struct Segment {
+    GLZWUint in_bit, out_off;
+} Segment;
+
+typedef struct Segments {
+    Segment *seg;
+    GLZWUint n, size;
+} Segments;
+
+/* Phase 2: write the strings for codes[ck->index] up to end_index at their
+ * final places in the output.  Only the finished table (ents[]) is read,
+ * so any number of these can run at once. */
+static void expand(void *arg)
+{
+    const Expand_job *job = (const Expand_job *)arg;
+    const GLZWUshort *codes = job->codes;
+    const GLZWUint *ents = job->ents;
+    GLZWUint clear_code = job->clear_code, end_code = clear_code + 1;
+    GLZWUint base = job->ck->base, next_code = job->ck->next_code;
+    GLZWUint initial = job->ck->initial, i, c, e;
+    GLZWByte *out_ptr = job->out + job->ck->out_off, *p;
+
+    for (i = job->ck->index; i < job->end_index; i++) {
+        c = codes[i];
+        if (c == clear_code) {
+            base += next_code - (end_code + 1);
+            next_code = end_code + 1;
+            initial = 1;
+            continue;
+        }
+        if (c < clear_code) {
+            *out_ptr++ = (GLZWByte)c;
+        } else {
+            e = ents[base + c - (end_code + 1)];
+            out_ptr += e >> 20;
+            p = out_ptr;
+            while (c >= clear_code) {
+                e = ents[base + c - (end_code + 1)];
+                *--p = e & 0xFF;
+                c = (e >> 8) & 0xFFF;
+            }
+            *--p = (GLZWByte)c;
+        }
+        if (!initial && next_code < CODE_LIMIT)
+            next_code++;
+        initial = 0;
+    }
+}
+
+/* Decode a complete LZW stream in two phases.  Phase 1 runs through the
+ * codes in order, making the table entries for each segment (the codes
+ * between CLEARs) in ents[] and adding up string lengths to find where
+ * each string goes.  Entries are never changed once made, so in phase 2
+ * the strings can be written in any order; the codes are split into about
+ * nthreads runs of equal output size, each expanded by its own thread.
+ *
+ * ents[] entries are packed as in glzwd.c: length in bits 20-31, head in
+ * bits 8-19, tail in bits 0-7.  A segment's entries start at the ents[]
+ * index after the previous segment's.
+ *
+ * If the output does not hold the whole stream, it is filled, the last
+ * string being cut short, and GLZW_NO_OUTPUT_AVAIL is returned.  If the
+ * input ends without an END code or has an invalid code, the strings for
+ * the codes before that point are written and GLZW_NO_INPUT_AVAIL or
+ * GLZW_INVALID_DATA returned.
+ */
+int glzwdp(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWByte *out_ptr, GLZWUint *out_avail,
+        GLZWUint nthreads)
+{
+    GLZWUint clear_code = 1 << lzw_min_code_width;
+    GLZWUint end_code = clear_code + 1;
+    GLZWUint next_code = end_code + 1, base = 0, initial = 1;
+    GLZWUint ncodes, out_off = 0, nck = 0, i, t, c, cur_first, len = 0, cut = 0;
+    GLZWUshort *codes;
+    GLZWUint *ents;
+    Checkpoint *ck;
+    Expand_job jobs[MAX_THREADS];
+    GLZWByte first[CODE_LIMIT];     /* first byte of each entry's string */
+    GLZWByte stack[STACK_SIZE], *p;
+    int r, ret;
+
+    /* Codes are at least lzw_min_code_width + 1 bits.  Their count must fit
+     * in a GLZWUint, and ents[] in a size_t. */
+    if (in_avail / (lzw_min_code_width + 1) >= UINT_MAX / 8 ||
+            in_avail / (lzw_min_code_width + 1) >=
+                                    (size_t)-1 / 8 / sizeof(GLZWUint))
+        return GLZW_OUT_OF_MEMORY;
+    ncodes = (in_avail / (lzw_min_code_width + 1) + 1) * 8;
+    codes = (GLZWUshort *)malloc(ncodes * sizeof(GLZWUshort));
+    ents = (GLZWUint *)malloc(ncodes * sizeof(GLZWUint));
+    ck = (Checkpoint *)malloc((ncodes / CHECK_CODES + 2) * sizeof(Checkpoint));
+    if (!codes || !ents || !ck) {
+        ret = GLZW_OUT_OF_MEMORY;
+        goto done;
+    }
+    r = glzwd_unpack(in_ptr, in_avail, lzw_min_code_width, codes, &ncodes);
+    ret = r;
+    if (r == GLZW_NO_OUTPUT_AVAIL) {
+        /* codes[] is big enough for any stream of in_avail bytes. */
+        ret = GLZW_INTERNAL_ERROR;
+        goto done;
+    }
+
+    /* Phase 1.  glzwd_unpack() has checked each code is valid. */
+    for (i = 0; i < ncodes; i++) {
+        if (i % CHECK_CODES == 0) {
+            ck[nck].index = i;
+            ck[nck].out_off = out_off;
+            ck[nck].base = base;
+            ck[nck].next_code = next_code;
+            ck[nck].initial = initial;
+            nck++;
+        }
+        c = codes[i];
+        if (c == clear_code) {
+            base += next_code - (end_code + 1);
+            next_code = end_code + 1;
+            initial = 1;
+            continue;
+        }
+        if (c == end_code)
+            break;
+        if (c < clear_code) {
+            cur_first = first[c] = (GLZWByte)c;
+            len = 1;
+        } else {
+            cur_first = c == next_code ? first[codes[i - 1]] : first[c];
+        }
+        if (!initial && next_code < CODE_LIMIT) {
+            /* The entry is the previous string plus this one's first byte.
+             * For KwKwK, c is this entry, so its length is known only now. */
+            GLZWUint prev = codes[i - 1];
+            GLZWUint prev_len = prev < clear_code ? 1 :
+                            ents[base + prev - (end_code + 1)] >> 20;
+            ents[base + next_code - (end_code + 1)] =
+                            (prev_len + 1) << 20 | prev << 8 | cur_first;
+            first[next_code] = first[prev];
+            next_code++;
+        }
+        if (c >= clear_code)
+            len = ents[base + c - (end_code + 1)] >> 20;
+        initial = 0;
+        if (len > *out_avail - out_off) {
+            cut = 1;
+            break;
+        }
+        out_off += len;
+    }
+    ck[nck].index = i;
+    ck[nck].out_off = out_off;
+    ck[nck].base = base;
+    ck[nck].next_code = next_code;
+    ck[nck].initial = initial;
+
+    /* Phase 2. */
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    for (t = 0, c = 0; t < nthreads; t++) {
+        /* Start at the first checkpoint at or after this thread's share. */
+        while (c < nck && ck[c].out_off <
+                        (unsigned long long)out_off * t / nthreads)
+            c++;
+        jobs[t].codes = codes;
+        jobs[t].ents = ents;
+        jobs[t].ck = ck + c;
+        jobs[t].clear_code = clear_code;
+        jobs[t].out = out_ptr;
+        if (t)
+            jobs[t - 1].end_index = ck[c].index;
+    }
+    jobs[nthreads - 1].end_index = i;
+    run_jobs(expand, jobs, sizeof(jobs[0]), nthreads);
+
+    if (cut) {
+        /* Write the part of the last string that fits. */
+        c = codes[i];
+        p = stack + STACK_SIZE;
+        while (c >= clear_code) {
+            *--p = ents[base + c - (end_code + 1)] & 0xFF;
+            c = (ents[base + c - (end_code + 1)] >> 8) & 0xFFF;
+        }
+        *--p = (GLZWByte)c;
+        while (out_off < *out_avail)
+            out_ptr[out_off++] = *p++;
+        ret = GLZW_NO_OUTPUT_AVAIL;
+    }
+    *out_avail -= out_off;
+
+done:
+    free(codes);
+    free(ents);
+    free(ck);
+    return ret;
+}
+
+static void decode_run(void *arg)
+{
+    Split_job *job = (Split_job *)arg;
+    GLZWUint in_avail = job->in_avail, out_avail = job->out_len;
+    void *state;
+
+    job->ret = GLZW_OK;
+    if (!out_avail)
+        return;
+    job->ret = glzwd_init(&state, job->lzw_min_code_width);
+    if (job->ret)
+        return;
+    glzwd_set_option(state, GLZWD_OPT_SKIP_BITS, job->in_bit);
+    job->ret = glzwd(state, job->in_ptr, job->out_ptr, &in_avail, &out_avail);
+    /* Stopping when its share of the output is full is success. */
+    if (job->ret == GLZW_NO_OUTPUT_AVAIL && !out_avail)
+        job->ret = GLZW_OK;
+    glzwd_end(state);
+}
+
+static int add_segment(void *arg, GLZWUint in_bit, GLZWUint out_off)
+{
+    Segments *sg = (Segments *)arg;
+    if (sg->n == sg->size) {
+        GLZWUint size = sg->size ? sg->size * 2 : 64;
+        Segment *seg = (Segment *)realloc(sg->seg, size * sizeof(Segment));
+        if (!seg)
+            return GLZW_OUT_OF_MEMORY;
+        sg->seg = seg;
+        sg->size = size;
+    }
+    sg->seg[sg->n].in_bit = in_bit;
+    sg->seg[sg->n].out_off = out_off;
+    sg->n++;
+    return GLZW_OK;
+}
+
+/* Decode a complete LZW stream by splitting it at CLEAR codes.  Each CLEAR
+ * resets the decoder, so the segments between them can be decoded apart
+ * once their output offsets are known.  glzwd_scan() finds them without
+ * writing any output; then the segments are grouped into nthreads runs of
+ * about equal output size, and each run is decoded by glzwd() with its
+ * own state, started at the run's first segment and stopped by giving it
+ * just the run's output.  A stream with few CLEARs gives few runs.
+ *
+ * Arguments and return values are as for glzwdp().
+ */
+int glzwdp_split(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWByte *out_ptr, GLZWUint *out_avail,
+        GLZWUint nthreads)
+{
+    Segments sg = {NULL, 0, 0};
+    Split_job jobs[MAX_THREADS];
+    GLZWUint total = 0, size, start, t, k;
+    int ret;
+
+    ret = add_segment(&sg, 0, 0);
+    if (!ret)
+        ret = glzwd_scan(in_ptr, in_avail, lzw_min_code_width,
+                                            add_segment, &sg, &total);
+    if (ret == GLZW_OUT_OF_MEMORY)
+        goto done;
+    size = total;
+    if (size > *out_avail) {
+        size = *out_avail;
+        ret = GLZW_NO_OUTPUT_AVAIL;
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    for (t = 0, k = 0; t < nthreads; t++) {
+        /* Start at the first segment at or after this thread's share. */
+        while (k < sg.n - 1 && sg.seg[k].out_off <
+                        (unsigned long long)size * t / nthreads)
+            k++;
+        start = sg.seg[k].out_off < size ? sg.seg[k].out_off : size;
+        /* Start at the segment's byte, skipping only the bits before it
+         * in that byte, as glzwdx_decode() does. */
+        jobs[t].in_ptr = in_ptr + (sg.seg[k].in_bit >> 3);
+        jobs[t].in_avail = in_avail - (sg.seg[k].in_bit >> 3);
+        jobs[t].lzw_min_code_width = lzw_min_code_width;
+        jobs[t].in_bit = sg.seg[k].in_bit & 7;
+        jobs[t].out_ptr = out_ptr + start;
+        if (t)
+            jobs[t - 1].out_len = start - (jobs[t - 1].out_ptr - out_ptr);
+    }
+    jobs[nthreads - 1].out_len = size - (jobs[nthreads - 1].out_ptr - out_ptr);
+    run_jobs(decode_run, jobs, sizeof(jobs[0]), nthreads);
+    for (t = 0; t < nthreads; t++) {
+        if (jobs[t].ret != GLZW_OK) {
+            ret = jobs[t].ret;
+            break;
+        }
+    }
+    *out_avail -= size;
+
+done:
+    free(sg.seg);
+    return ret;
+}
@@ -0,0 +1,22 @@
+/* glzwdp.h -- GIF LZW two-phase (parallel) decoder interface
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+typedef unsigned char GLZWByte;
+typedef unsigned int GLZWUint;
+
+/* Return values */
+#define GLZW_OK                 0
+#define GLZW_NO_INPUT_AVAIL     1
+#define GLZW_NO_OUTPUT_AVAIL    2
+#define GLZW_OUT_OF_MEMORY      3
+#define GLZW_INTERNAL_ERROR     4
+#define GLZW_INVALID_DATA       5
+
+int glzwdp(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWByte *out_ptr, GLZWUint *out_avail,
+        GLZWUint nthreads);
+
+int glzwdp_split(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWByte *out_ptr, GLZWUint *out_avail,
+        GLZWUint nthreads);
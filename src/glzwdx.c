@@ -0,0 +1,242 @@
+/* glzwdx.c -- GIF LZW decoder seek index
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+/* string.h for memcmp(); stdlib.h for malloc()/free(). */
+#include <string.h>
+#include <stdlib.h>
+
+#include "glzwd.h"
+#include "glzwdx.h"
+
+/* Output discarded on the way to the start of a range goes here. */
+#define SKIP_BUF_SIZE   65536
+
+/* Saved index: "GLZX", version, lzw_min_code_width, then as varints
+ * (7 bits a byte, low first, high bit set on all but the last) out_size,
+ * npoints, and for each point the increase in in_bit and in out_off from
+ * the point before. */
+#define INDEX_VERSION   1
+
+static int add_point(void *arg, GLZWUint in_bit, GLZWUint out_off)
+{
+    Glzwdx_index *ix = (Glzwdx_index *)arg;
+    if (ix->npoints == ix->size) {
+        GLZWUint size = ix->size ? ix->size * 2 : 64;
+        Glzwdx_point *points = (Glzwdx_point *)realloc(ix->points,
+                                                size * sizeof(Glzwdx_point));
+        if (!points)
+            return GLZW_OUT_OF_MEMORY;
+        ix->points = points;
+        ix->size = size;
+    }
+    ix->points[ix->npoints].in_bit = in_bit;
+    ix->points[ix->npoints].out_off = out_off;
+    ix->npoints++;
+    return GLZW_OK;
+}
+
+/* Build an index of the places in a complete LZW stream where decoding can
+ * start: the start, and just after each CLEAR code.  If the stream is
+ * truncated or invalid, the index covers the part before that, and the
+ * error is returned with the index.  lzw_min_code_width must be 2 to 8,
+ * as glzwdx_load() requires. */
+int glzwdx_build(void **pindex, const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width)
+{
+    Glzwdx_index *ix;
+    int r;
+    *pindex = NULL;
+    if (lzw_min_code_width < 2 || lzw_min_code_width > 8)
+        return GLZW_INVALID_DATA;
+    ix = (Glzwdx_index *)calloc(1, sizeof(Glzwdx_index));
+    *pindex = ix;
+    if (!ix)
+        return GLZW_OUT_OF_MEMORY;
+    ix->lzw_min_code_width = lzw_min_code_width;
+    r = add_point(ix, 0, 0);
+    if (!r)
+        r = glzwd_scan(in_ptr, in_avail, lzw_min_code_width, add_point, ix,
+                                                            &ix->out_size);
+    if (r == GLZW_OUT_OF_MEMORY) {
+        glzwdx_end(ix);
+        *pindex = NULL;
+    }
+    return r;
+}
+
+/* Decode the output from out_off for *out_avail bytes, or to the end of
+ * the output if that comes first, starting at the nearest point at or
+ * before out_off.  *out_avail is reduced by the bytes written.  in_ptr
+ * and in_avail are the whole stream, as given to glzwdx_build(). */
+int glzwdx_decode(void *index, const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint out_off, GLZWByte *out_ptr, GLZWUint *out_avail)
+{
+    Glzwdx_index *ix = (Glzwdx_index *)index;
+    GLZWUint lo = 0, hi = ix->npoints, mid, in_bit, skip, ia, oa;
+    GLZWByte *skip_buf = NULL;
+    void *state;
+    int r;
+
+    if (out_off >= ix->out_size || !*out_avail)
+        return GLZW_OK;
+    /* Last point at or before out_off; points[0] is at 0. */
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (ix->points[mid].out_off <= out_off)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    in_bit = ix->points[lo].in_bit;
+    if (in_bit / 8 >= in_avail)
+        return GLZW_NO_INPUT_AVAIL;
+    in_ptr += in_bit / 8;
+    in_avail -= in_bit / 8;
+    r = glzwd_init(&state, ix->lzw_min_code_width);
+    if (r)
+        return r;
+    glzwd_set_option(state, GLZWD_OPT_SKIP_BITS, in_bit % 8);
+    skip = out_off - ix->points[lo].out_off;
+    if (skip) {
+        skip_buf = (GLZWByte *)malloc(SKIP_BUF_SIZE);
+        if (!skip_buf) {
+            glzwd_end(state);
+            return GLZW_OUT_OF_MEMORY;
+        }
+    }
+    while (skip) {
+        ia = in_avail;
+        oa = skip < SKIP_BUF_SIZE ? skip : SKIP_BUF_SIZE;
+        skip -= oa;
+        r = glzwd(state, in_ptr, skip_buf, &ia, &oa);
+        in_ptr += in_avail - ia;
+        in_avail = ia;
+        if (r != GLZW_NO_OUTPUT_AVAIL)
+            goto done;
+    }
+    ia = in_avail;
+    oa = *out_avail;
+    r = glzwd(state, in_ptr, out_ptr, &ia, &oa);
+    *out_avail = oa;
+    /* Filling the output is success here. */
+    if (r == GLZW_NO_OUTPUT_AVAIL)
+        r = GLZW_OK;
+done:
+    free(skip_buf);
+    glzwd_end(state);
+    return r;
+}
+
+/* Put v at buf[pos], if it fits in size bytes, and return the position
+ * after it either way. */
+static GLZWUint put_varint(GLZWByte *buf, GLZWUint size, GLZWUint pos,
+        GLZWUint v)
+{
+    do {
+        if (pos < size)
+            buf[pos] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        pos++;
+        v >>= 7;
+    } while (v);
+    return pos;
+}
+
+static const GLZWByte *get_varint(const GLZWByte *p, const GLZWByte *end,
+        GLZWUint *v)
+{
+    GLZWUint shift = 0;
+    *v = 0;
+    do {
+        if (p == end || shift > 28)
+            return NULL;
+        *v |= (GLZWUint)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+/* Write the index to buf, *buf_size bytes long, setting *buf_size to the
+ * size of the saved index.  If buf is NULL or too small, nothing useful is
+ * written and GLZW_NO_OUTPUT_AVAIL returned, with *buf_size set to the
+ * size needed. */
+int glzwdx_save(void *index, GLZWByte *buf, GLZWUint *buf_size)
+{
+    Glzwdx_index *ix = (Glzwdx_index *)index;
+    GLZWUint size = buf ? *buf_size : 0, pos = 6;
+    GLZWUint i, in_bit = 0, out_off = 0;
+
+    if (size >= 6) {
+        memcpy(buf, "GLZX", 4);
+        buf[4] = INDEX_VERSION;
+        buf[5] = (GLZWByte)ix->lzw_min_code_width;
+    }
+    pos = put_varint(buf, size, pos, ix->out_size);
+    pos = put_varint(buf, size, pos, ix->npoints);
+    for (i = 0; i < ix->npoints; i++) {
+        pos = put_varint(buf, size, pos, ix->points[i].in_bit - in_bit);
+        pos = put_varint(buf, size, pos, ix->points[i].out_off - out_off);
+        in_bit = ix->points[i].in_bit;
+        out_off = ix->points[i].out_off;
+    }
+    *buf_size = pos;
+    return !buf || pos > size ? GLZW_NO_OUTPUT_AVAIL : GLZW_OK;
+}
+
+/* Make an index from one saved by glzwdx_save(). */
+int glzwdx_load(void **pindex, const GLZWByte *buf, GLZWUint buf_size)
+{
+    const GLZWByte *p = buf, *end = buf + buf_size;
+    Glzwdx_index *ix;
+    GLZWUint i, n, d_bit, d_off, in_bit = 0, out_off = 0;
+
+    *pindex = NULL;
+    if (buf_size < 6 || memcmp(p, "GLZX", 4) || p[4] != INDEX_VERSION ||
+                        p[5] < 2 || p[5] > 8)
+        return GLZW_INVALID_DATA;
+    ix = (Glzwdx_index *)calloc(1, sizeof(Glzwdx_index));
+    if (!ix)
+        return GLZW_OUT_OF_MEMORY;
+    ix->lzw_min_code_width = p[5];
+    p += 6;
+    if (!(p = get_varint(p, end, &ix->out_size)) ||
+                !(p = get_varint(p, end, &n)) || !n || n > buf_size)
+        goto invalid;
+    ix->points = (Glzwdx_point *)malloc(n * sizeof(Glzwdx_point));
+    if (!ix->points) {
+        glzwdx_end(ix);
+        return GLZW_OUT_OF_MEMORY;
+    }
+    ix->size = n;
+    for (i = 0; i < n; i++) {
+        if (!(p = get_varint(p, end, &d_bit)) ||
+                    !(p = get_varint(p, end, &d_off)))
+            goto invalid;
+        /* glzwdx_decode() searches the points by out_off, so they must
+         * not go back; each is at least one code after the one before. */
+        if ((i && !d_bit) || in_bit + d_bit < in_bit ||
+                    out_off + d_off < out_off)
+            goto invalid;
+        in_bit += d_bit;
+        out_off += d_off;
+        ix->points[i].in_bit = in_bit;
+        ix->points[i].out_off = out_off;
+    }
+    ix->npoints = n;
+    if (ix->points[0].in_bit || ix->points[0].out_off ||
+                        out_off > ix->out_size)
+        goto invalid;
+    *pindex = ix;
+    return GLZW_OK;
+invalid:
+    glzwdx_end(ix);
+    return GLZW_INVALID_DATA;
+}
+
+void glzwdx_end(void *index)
+{
+    Glzwdx_index *ix = (Glzwdx_index *)index;
+    if (ix)
+        free(ix->points);
+    free(ix);
+}
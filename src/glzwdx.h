@@ -0,0 +1,39 @@
+/* glzwdx.h -- GIF LZW decoder seek index interface
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+typedef unsigned char GLZWByte;
+typedef unsigned int GLZWUint;
+
+/* Return values */
+#define GLZW_OK                 0
+#define GLZW_NO_INPUT_AVAIL     1
+#define GLZW_NO_OUTPUT_AVAIL    2
+#define GLZW_OUT_OF_MEMORY      3
+#define GLZW_INTERNAL_ERROR     4
+#define GLZW_INVALID_DATA       5
+
+/* A point just after a CLEAR code, where decoding can start. */
+typedef struct Glzwdx_point {
+    GLZWUint in_bit;        /* bit offset in the stream of the next code */
+    GLZWUint out_off;       /* output offset there */
+} Glzwdx_point;
+
+typedef struct Glzwdx_index {
+    GLZWUint lzw_min_code_width;
+    GLZWUint out_size;      /* length of the whole output */
+    GLZWUint npoints, size;
+    Glzwdx_point *points;
+} Glzwdx_index;
+
+int glzwdx_build(void **pindex, const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width);
+
+int glzwdx_decode(void *index, const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint out_off, GLZWByte *out_ptr, GLZWUint *out_avail);
+
+int glzwdx_save(void *index, GLZWByte *buf, GLZWUint *buf_size);
+
+int glzwdx_load(void **pindex, const GLZWByte *buf, GLZWUint buf_size);
+
+void glzwdx_end(void *index);
@@ -8,8 +8,17 @@
 /* string.h for memset(); stdlib.h for calloc()/free(). */
 #include <string.h>
 #include <stdlib.h>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #include "glzwe.h"
+#define GLZW_LOAD_LE64
+#define GLZW_STORE_LE64
+#include "glzwint.h"
 
 #ifdef TESTDEV
 int nsuccesses, nfails, nreprobes, ninserts;    /* Temp for dev. */
@@ -18,26 +27,176 @@ int print_enc_codes;                            /* Temp for dev. */
 
 #define CODE_LIMIT  4096
 
+/* Hashes found experimentally to be pretty good.  The reprobe decrement
+ * must be nonzero and relatively prime to table size.  These decrements
+ * found experimentally to be pretty good.  The encoder uses one pair or the
+ * other, as chosen by GLZWE_OPT_TABLE. */
+/* This works ONLY with TABLE_SIZE_POW2 a power of 2: */
+#define TABLE_SIZE_POW2         8192
+#define HASH_POW2(head, tail)   \
+                ((((head) ^ ((tail) << 6)) * 31) & (TABLE_SIZE_POW2 - 1))
+#define REPROBE_POW2(tail)      (((tail) << 2) | 1)
+
+#define TABLE_SIZE_PRIME        4801
+#define HASH_PRIME(head, tail)  \
+                (((head) * 211 + (tail) * 17) % TABLE_SIZE_PRIME)
+#define REPROBE_PRIME(tail)     ((tail) + 1)
+
+/* For the byte at a time paths. */
+#define PRIME(st)               ((st)->table == GLZWE_TABLE_PRIME)
+#define HASH(st, head, tail)    (PRIME(st) ? HASH_PRIME(head, tail) : \
+                                            HASH_POW2(head, tail))
+#define REPROBE(st, tail)       (PRIME(st) ? REPROBE_PRIME(tail) : \
+                                            REPROBE_POW2(tail))
+#define SLOTS(st)       (PRIME(st) ? TABLE_SIZE_PRIME : TABLE_SIZE_POW2)
+
+/* With GLZWE_CLEAR_RATIO, how often to check the ratio once the table is
+ * full, in input bytes.  compress(1) uses 10000; for GIF images a shorter
+ * gap gave smaller output, mostly by clearing sooner on noisy data. */
+#define CHECK_GAP       1000
+
+/* With GLZWE_LITERAL_AUTO, how many bytes to write as literal codes before
+ * trying LZW again for a table's worth. */
+#define LIT_SPAN        65536
+
+/* GLZWE_OPT_LOOKAHEAD: a string in the table is at most about 4096 bytes,
+ * so choosing one needs at most twice that much input buffered. */
+#define LA_NEED         (2 * CODE_LIMIT)
+#define LA_BUF_SIZE     (4 * CODE_LIMIT)
+/* A shorter string costs the table the longer entry it would have made, so
+ * it is taken only if it gets at least this many more bytes into the next
+ * string.  3 was no worse than plain LZW on any of the test images. */
+#define LA_MARGIN       3
+
+/* glzwe_bulk() is used when there is at least this much input and output.
+ * It stores 8 bytes for each code, and may store a CLEAR code after it. */
+#define BULK_MIN_IN     16
+#define BULK_MIN_OUT    16
+
+/* A code and a CLEAR code after it take at most 3 bytes, so with this many
+ * bytes past *out_avail to store into, glzwe_bulk() can go on until 3
+ * bytes are left (out_slack). */
+#define SUB_SLACK       (BULK_MIN_OUT - 3)
+
 /* values of entry_state */
 enum { LZW_INITIAL, LZW_TRY_IN1, LZW_TRY_IN2, LZW_TRY_OUT1, LZW_TRY_OUT2,
     LZW_FINISHED };
 
+/* values of sb_state */
+enum { SB_FILL, SB_FLUSH, SB_FLUSH_LAST, SB_TERMINATE, SB_DONE };
+
 /* values of control_state */
-enum { PUT_HEAD, PUT_INIT_CLEAR, PUT_CLEAR, PUT_LAST_HEAD, PUT_END };
+enum { PUT_HEAD, PUT_INIT_CLEAR, PUT_CLEAR, PUT_LAST_HEAD, PUT_END,
+    PUT_LITERAL };
+
+/* Count the bytes equal to b from p on, up to n of them. */
+static GLZWUint run_length(const GLZWByte *p, GLZWUint n, GLZWUint b)
+{
+    const GLZWByte *start = p, *end = p + n;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i v = _mm_set1_epi8((char)b);
+    while (end - p >= 16) {
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(
+                    _mm_loadu_si128((const __m128i *)p), v)) != 0xFFFF)
+            break;
+        p += 16;
+    }
+#else
+    Bitbuf v = (Bitbuf)b * 0x0101010101010101ULL;
+    while (end - p >= 8 && load_le64(p) == v)
+        p += 8;
+#endif
+    while (p < end && *p == b)
+        p++;
+    return (GLZWUint)(p - start);
+}
+
+/* GLZWE_OPT_RUNS: forget the codes for runs. */
+static void reset_runs(Glzwe_state *st)
+{
+    int b;
+    for (b = 0; b < 256; b++) {
+        st->run_last[b] = b;
+        st->run_len[b] = 0;
+    }
+}
 
 static void glzwe_reset(Glzwe_state *st)
 {
     st->next_code = st->end_code + 1;
     st->max_code = 2 * st->clear_code - 1;
     st->code_width = st->lzw_min_code_width + 1;
-    memset(st->codes, 0, sizeof(st->codes));
+    /* Start a new epoch instead of clearing the table.  The dense table
+     * needs neither; stale entries fail the key check. */
+    if (++st->epoch > 255) {
+        memset(st->epochs, 0, sizeof(st->epochs));
+        memset(st->pred, 0, sizeof(st->pred));
+        st->epoch = 1;
+    }
+    /* Otherwise a CLEAR costs the same however large the tables. */
+    if (st->runs)
+        reset_runs(st);
+    st->in_count = 0;
+    st->out_bits = 0;
+    st->ratio = 0;
+    /* GLZWE_LITERAL_AUTO: back to LZW codes once the span is written. */
+    if (st->lit_mode == GLZWE_LITERAL_AUTO && !st->lit_left)
+        st->lit_on = 0;
+}
+
+/* The table is full: decide whether to CLEAR it.  For GLZWE_CLEAR_RATIO,
+ * note the input bytes per output bit of the block so far, the price of
+ * building a new table.  Then every CHECK_GAP input bytes compare the
+ * ratio over those bytes, and CLEAR if the full table is doing worse. */
+static int clear_due(Glzwe_state *st)
+{
+    GLZWUint rat;
+    switch (st->clear_policy) {
+    case GLZWE_CLEAR_NEVER:
+        return 0;
+    case GLZWE_CLEAR_RATIO:
+        if (st->ratio && st->in_count < CHECK_GAP)
+            return 0;
+        rat = (GLZWUint)(((Bitbuf)st->in_count << 16) / (st->out_bits + 1));
+        st->in_count = 0;
+        st->out_bits = 0;
+        if (!st->ratio) {
+            st->ratio = rat ? rat : 1;
+            return 0;
+        }
+        return rat < st->ratio;
+    default:
+        return 1;
+    }
+}
+
+/* The table is full: with GLZWE_LITERAL_AUTO, decide whether to write
+ * literal codes for the next LIT_SPAN bytes.  They take w bits a byte and a
+ * CLEAR code every clear_code - 2 bytes; switch if the input since the last
+ * CLEAR (or ratio check) took at least that many bits.  A CLEAR code is
+ * then due, after which literal codes start. */
+static int literal_due(Glzwe_state *st)
+{
+    GLZWUint w = st->lzw_min_code_width + 1;
+    GLZWUint group = st->clear_code - 2;
+    if (st->lit_mode != GLZWE_LITERAL_AUTO || st->in_count < CHECK_GAP ||
+            (Bitbuf)st->out_bits * group <
+                                (Bitbuf)st->in_count * w * (group + 1))
+        return 0;
+    st->lit_on = 1;
+    st->lit_left = LIT_SPAN;
+    return 1;
 }
 
 int glzwe_init(void **pstate, const GLZWUint lzw_min_code_width)
 {
     /*Glzwe_state *st = *pst = (Glzwe_state *)calloc(1, sizeof(Glzwe_state));
      */
-    Glzwe_state *st = (Glzwe_state *)calloc(1, sizeof(Glzwe_state));
+    Glzwe_state *st;
+    *pstate = NULL;
+    if (lzw_min_code_width < 2 || lzw_min_code_width > 8)
+        return GLZW_INVALID_OPTION;
+    st = (Glzwe_state *)calloc(1, sizeof(Glzwe_state));
     *pstate = st;
     if (!st) {
         return GLZW_OUT_OF_MEMORY;
@@ -45,6 +204,7 @@ int glzwe_init(void **pstate, const GLZWUint lzw_min_code_width)
     st->lzw_min_code_width = lzw_min_code_width;
     st->clear_code = 1 << st->lzw_min_code_width;
     st->end_code = st->clear_code + 1;
+    st->table = FASTER_HASH ? GLZWE_TABLE_POW2 : GLZWE_TABLE_PRIME;
     glzwe_reset(st);
     st->entry_state = LZW_INITIAL;
     st->buf_bits_left = 8;
@@ -52,11 +212,409 @@ int glzwe_init(void **pstate, const GLZWUint lzw_min_code_width)
     return GLZW_OK;
 }
 
-int glzwe(void *state, const GLZWByte *in_ptr, GLZWByte *out_ptr,
-        GLZWUint *in_avail, GLZWUint *out_avail,
+/* Find head + tail in the table.  Returns its code, or CODE_LIMIT if it
+ * is not there; either way st->probe is where it is or would go. */
+static GLZWUint find(Glzwe_state *st, GLZWUint head, GLZWUint tail)
+{
+    GLZWUint key = (head << 8) | tail, code;
+    if (st->child) {
+        st->probe = (head << st->lzw_min_code_width) |
+                                        (tail & (st->clear_code - 1));
+        code = st->child[st->probe];
+        return code < st->next_code && st->key[code] == key ?
+                                                        code : CODE_LIMIT;
+    }
+    st->probe = HASH(st, head, tail);
+    while (st->epochs[st->probe] == st->epoch) {
+        if ((st->codes[st->probe] & 0xFFFFF) == key)
+            return st->codes[st->probe] >> 20;
+        if ((st->probe -= REPROBE(st, tail)) < 0)
+            st->probe += SLOTS(st);
+    }
+    return CODE_LIMIT;
+}
+
+/* Length of the longest string in the table that p[0..n-1] starts with.
+ * If codes is not NULL, codes[k] is set to the code of its first k bytes. */
+static GLZWUint longest_match(Glzwe_state *st, const GLZWByte *p,
+        GLZWUint n, GLZWUshort *codes)
+{
+    GLZWUint len = 1, head = p[0], code;
+    if (codes)
+        codes[1] = head;
+    while (len < n && (code = find(st, head, p[len])) != CODE_LIMIT) {
+        head = code;
+        if (codes)
+            codes[len + 1] = head;
+        len++;
+    }
+    return len;
+}
+
+/* Add a code to la_out, leaving a partial byte in code_buffer. */
+static void la_put(Glzwe_state *st, GLZWUint code)
+{
+    GLZWUint nbits = 8 - st->buf_bits_left;
+    Bitbuf acc = st->code_buffer | (Bitbuf)code << nbits;
+#ifdef TESTDEV
+if (print_enc_codes) printf("enc code: %d\n", code);
+#endif
+    nbits += st->code_width;
+    st->out_bits += st->code_width;
+    while (nbits >= 8) {
+        st->la_out[st->la_out_len++] = (GLZWByte)acc;
+        acc >>= 8;
+        nbits -= 8;
+    }
+    st->code_buffer = (GLZWUint)acc;
+    st->buf_bits_left = 8 - nbits;
+}
+
+/* Write one string, and a CLEAR if needed, to la_out.  The string at
+ * la_buf + la_pos is chosen by looking one string ahead (flexible
+ * parsing): of the longest match and up to la_span shorter prefixes of
+ * it, take the one followed by the longest match, so that the two
+ * together cover the most input, preferring the longer string.  Any
+ * string in the table gives a valid stream; as with the usual longest
+ * match, the decoder adds the last string plus the first byte of this one
+ * to its table, and so must the encoder, even if that string is already
+ * there. */
+static void la_step(Glzwe_state *st)
+{
+    GLZWUshort codes[CODE_LIMIT + 1];
+    const GLZWByte *p = st->la_buf + st->la_pos;
+    GLZWUint n = st->la_len - st->la_pos;
+    GLZWUint len, best_len, best, l, reach;
+
+    if (st->la_prev != CODE_LIMIT) {
+        if (st->next_code < CODE_LIMIT) {
+            if (find(st, st->la_prev, p[0]) != CODE_LIMIT) {
+                /* The code is used up, but is never written; keep a stale
+                 * key from matching a dense table entry. */
+                if (st->child)
+                    st->key[st->next_code] = ~0u;
+            } else {
+                if (st->child) {
+                    st->child[st->probe] = st->next_code;
+                    st->key[st->next_code] = (st->la_prev << 8) | p[0];
+                } else {
+                    st->codes[st->probe] = (st->next_code << 20) |
+                                            (st->la_prev << 8) | p[0];
+                    st->epochs[st->probe] = st->epoch;
+                }
+            }
+            if (st->next_code > st->max_code) {
+                st->max_code = st->max_code * 2 + 1;
+                st->code_width++;
+            }
+            st->next_code++;
+        } else if (clear_due(st)) {
+            la_put(st, st->clear_code);
+            glzwe_reset(st);
+            st->la_prev = CODE_LIMIT;
+        }
+    }
+    len = longest_match(st, p, n, codes);
+    best_len = len;
+    best = len + (len < n ? longest_match(st, p + len, n - len, NULL) : 0);
+    for (l = len - 1; l >= 1 && l + st->la_span >= len; l--) {
+        reach = l + longest_match(st, p + l, n - l, NULL);
+        if (reach >= best + LA_MARGIN) {
+            best = reach;
+            best_len = l;
+        }
+    }
+    la_put(st, codes[best_len]);
+    st->la_prev = codes[best_len];
+    st->la_pos += best_len;
+    st->in_count += best_len;
+}
+
+/* glzwe() with GLZWE_OPT_LOOKAHEAD.  Input is copied to la_buf, and
+ * encoded once LA_NEED bytes are there or all input is in; output goes
+ * through la_out. */
+static int glzwe_la(Glzwe_state *st, const GLZWByte *in_ptr,
+        GLZWByte *out_ptr, GLZWUint *in_avail, GLZWUint *out_avail,
         GLZWUint end_of_data)
 {
-    Glzwe_state *st = (Glzwe_state *)state;
+    GLZWUint n;
+    for (;;) {
+        while (st->la_out_pos < st->la_out_len) {
+            if (!*out_avail)
+                return GLZW_NO_OUTPUT_AVAIL;
+            *out_ptr++ = st->la_out[st->la_out_pos++];
+            (*out_avail)--;
+        }
+        st->la_out_pos = st->la_out_len = 0;
+        if (st->entry_state == LZW_FINISHED)
+            return GLZW_OK;
+        if (st->entry_state == LZW_INITIAL) {
+            glzwe_reset(st);
+            la_put(st, st->clear_code);
+            st->la_prev = CODE_LIMIT;
+            st->entry_state = LZW_TRY_IN2;
+            continue;
+        }
+        if (*in_avail && st->la_len - st->la_pos < LA_NEED) {
+            /* Move the input down only when the buffer is full, so that
+             * small inputs do not move it every time. */
+            if (st->la_len == LA_BUF_SIZE) {
+                memmove(st->la_buf, st->la_buf + st->la_pos,
+                                                st->la_len - st->la_pos);
+                st->la_len -= st->la_pos;
+                st->la_pos = 0;
+            }
+            n = LA_BUF_SIZE - st->la_len;
+            if (n > *in_avail)
+                n = *in_avail;
+            memcpy(st->la_buf + st->la_len, in_ptr, n);
+            st->la_len += n;
+            in_ptr += n;
+            *in_avail -= n;
+        }
+        if (st->la_len - st->la_pos < LA_NEED && (*in_avail || !end_of_data))
+            return GLZW_NO_INPUT_AVAIL;
+        if (st->la_pos < st->la_len) {
+            la_step(st);
+        } else {
+            /* As at end_of_data in glzwe(). */
+            if (st->next_code > st->max_code && st->next_code < CODE_LIMIT)
+                st->code_width++;
+            la_put(st, st->end_code);
+            if (st->buf_bits_left < 8)
+                st->la_out[st->la_out_len++] = (GLZWByte)st->code_buffer;
+            st->entry_state = LZW_FINISHED;
+        }
+    }
+}
+
+/* One glzwe_bulk() for each table, with the table's size and hash
+ * functions, or the dense table's lzw_min_code_width, as constants, and
+ * for the hash tables more with GLZWE_OPT_RUNS and GLZWE_OPT_PREDICT. */
+#define BULK_NAME           bulk_pow2
+#define BULK_HASH           HASH_POW2
+#define BULK_REPROBE        REPROBE_POW2
+#define BULK_TABLE_SIZE     TABLE_SIZE_POW2
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_prime
+#define BULK_HASH           HASH_PRIME
+#define BULK_REPROBE        REPROBE_PRIME
+#define BULK_TABLE_SIZE     TABLE_SIZE_PRIME
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_pow2_runs
+#define BULK_HASH           HASH_POW2
+#define BULK_REPROBE        REPROBE_POW2
+#define BULK_TABLE_SIZE     TABLE_SIZE_POW2
+#define BULK_RUNS
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_pow2_predict
+#define BULK_HASH           HASH_POW2
+#define BULK_REPROBE        REPROBE_POW2
+#define BULK_TABLE_SIZE     TABLE_SIZE_POW2
+#define BULK_PREDICT
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_pow2_runs_predict
+#define BULK_HASH           HASH_POW2
+#define BULK_REPROBE        REPROBE_POW2
+#define BULK_TABLE_SIZE     TABLE_SIZE_POW2
+#define BULK_RUNS
+#define BULK_PREDICT
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_prime_runs
+#define BULK_HASH           HASH_PRIME
+#define BULK_REPROBE        REPROBE_PRIME
+#define BULK_TABLE_SIZE     TABLE_SIZE_PRIME
+#define BULK_RUNS
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_prime_predict
+#define BULK_HASH           HASH_PRIME
+#define BULK_REPROBE        REPROBE_PRIME
+#define BULK_TABLE_SIZE     TABLE_SIZE_PRIME
+#define BULK_PREDICT
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_prime_runs_predict
+#define BULK_HASH           HASH_PRIME
+#define BULK_REPROBE        REPROBE_PRIME
+#define BULK_TABLE_SIZE     TABLE_SIZE_PRIME
+#define BULK_RUNS
+#define BULK_PREDICT
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense2
+#define BULK_MCW            2
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense3
+#define BULK_MCW            3
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense4
+#define BULK_MCW            4
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense5
+#define BULK_MCW            5
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense6
+#define BULK_MCW            6
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense7
+#define BULK_MCW            7
+#include "glzwe_bulk.h"
+#define BULK_NAME           bulk_dense8
+#define BULK_MCW            8
+#include "glzwe_bulk.h"
+
+typedef void Bulk_fn(Glzwe_state *st, const GLZWByte **pin,
+        GLZWByte **pout, GLZWUint *in_avail, GLZWUint *out_avail);
+
+/* Indexed by GLZWE_OPT_TABLE, GLZWE_OPT_RUNS and GLZWE_OPT_PREDICT. */
+static Bulk_fn *const bulk_hash[2][2][2] = {
+    {{bulk_pow2, bulk_pow2_predict}, {bulk_pow2_runs, bulk_pow2_runs_predict}},
+    {{bulk_prime, bulk_prime_predict},
+                                {bulk_prime_runs, bulk_prime_runs_predict}}
+};
+
+static Bulk_fn *const bulk_dense[9] = {
+    NULL, NULL, bulk_dense2, bulk_dense3, bulk_dense4, bulk_dense5,
+    bulk_dense6, bulk_dense7, bulk_dense8
+};
+
+/* Run the glzwe_bulk() for the table in use. */
+static void glzwe_bulk(Glzwe_state *st, const GLZWByte **pin,
+        GLZWByte **pout, GLZWUint *in_avail, GLZWUint *out_avail)
+{
+    if (st->child)
+        bulk_dense[st->lzw_min_code_width](st, pin, pout, in_avail, out_avail);
+    else
+        bulk_hash[st->table][st->runs][st->predict](st, pin, pout, in_avail,
+                                                                out_avail);
+}
+
+/* GLZWE_OPT_LITERAL: write head and the input after it as literal codes
+ * while there is input and room for output, entered and left at
+ * encode_loop as glzwe_bulk() is.  After each literal the decoder adds a
+ * table entry, so a CLEAR code follows every clear_code - 2 literals,
+ * before it would widen the codes.
+ *
+ * All codes are w bits, so literals away from the end of a group are packed
+ * lanes at a time: the bytes are loaded as one 64-bit word, and byte i is
+ * moved from bit 8 * i to bit w * i in three shift-and-mask steps, each
+ * moving the bytes with one bit of i set.  Bytes move up for w = 9 and
+ * down for w < 8; the farthest move first going up and the nearest going
+ * down, so they never overlap.  With BMI2 this is pext and pdep.
+ */
+static void glzwe_lit(Glzwe_state *st, const GLZWByte **pin,
+        GLZWByte **pout, GLZWUint *in_avail, GLZWUint *out_avail)
+{
+    const GLZWByte *in = *pin, *in_end = in + *in_avail;
+    GLZWByte *out = *pout;
+    GLZWByte *out_lim = out + *out_avail + st->out_slack - BULK_MIN_OUT;
+    GLZWUint w = st->lzw_min_code_width + 1, mask = st->clear_code - 1;
+    /* Up to 7 pending bits and a batch fit in 64 bits. */
+    GLZWUint lanes = 56 / w < 8 ? 56 / w : 8;
+    GLZWUint next_code = st->next_code, max_code = st->max_code;
+    GLZWUint head = st->head, lit_left = st->lit_left;
+    GLZWUint nbits = 8 - st->buf_bits_left, i, k, s, pos[8], up[3], down[3];
+    Bitbuf acc = st->code_buffer, x, y, lane_mask = 0, step_mask[3];
+#if defined(__BMI2__)
+    Bitbuf dep_mask = 0;
+#endif
+
+/* Append a code and store the completed bytes. */
+#define PUT_LIT(c) \
+    do { \
+        acc |= (Bitbuf)(c) << nbits; \
+        nbits += w; \
+        store_le64(out, acc); \
+        out += nbits >> 3; \
+        acc >>= nbits & ~7; \
+        nbits &= 7; \
+    } while (0)
+
+    for (i = 0; i < lanes; i++) {
+        lane_mask |= (Bitbuf)mask << 8 * i;
+        pos[i] = 8 * i;
+#if defined(__BMI2__)
+        dep_mask |= (Bitbuf)mask << w * i;
+#endif
+    }
+    for (s = 0; s < 3; s++) {
+        k = w > 8 ? 2 - s : s;
+        up[s] = w > 8 ? (w - 8) << k : 0;
+        down[s] = w < 8 ? (8 - w) << k : 0;
+        step_mask[s] = 0;
+        for (i = 0; i < lanes; i++) {
+            if (i >> k & 1) {
+                step_mask[s] |= (Bitbuf)mask << pos[i];
+                pos[i] = pos[i] + up[s] - down[s];
+            }
+        }
+    }
+
+    while (in < in_end && out <= out_lim && st->lit_on) {
+#ifdef TESTDEV
+if (print_enc_codes) printf("enc code: %d\n", head & mask);
+#endif
+        PUT_LIT(head & mask);
+        if (lit_left)
+            lit_left--;
+        if (next_code < max_code) {
+            next_code++;
+        } else {
+#ifdef TESTDEV
+if (print_enc_codes) printf("enc code: %d\n", st->clear_code);
+#endif
+            PUT_LIT(st->clear_code);
+            st->lit_left = lit_left;
+            glzwe_reset(st);
+            next_code = st->next_code;
+        }
+        /* Whole batches, ending before the group does, leaving a byte for
+         * the next head. */
+        while (next_code + lanes <= max_code && in_end - in > 8 &&
+                                    out + 4 <= out_lim && st->lit_on) {
+#ifdef TESTDEV
+if (print_enc_codes) for (i = 0; i < lanes; i++)
+    printf("enc code: %d\n", in[i] & mask);
+#endif
+#if defined(__BMI2__)
+            x = _pdep_u64(_pext_u64(load_le64(in), lane_mask), dep_mask);
+#else
+            x = load_le64(in) & lane_mask;
+            for (s = 0; s < 3; s++) {
+                y = x & step_mask[s];
+                x ^= y;
+                x |= y << up[s] >> down[s];
+            }
+#endif
+            acc |= x << nbits;
+            nbits += lanes * w;
+            store_le64(out, acc);
+            out += nbits >> 3;
+            acc >>= nbits & ~7;
+            nbits &= 7;
+            in += lanes;
+            next_code += lanes;
+            lit_left = lit_left > lanes ? lit_left - lanes : 0;
+        }
+        head = *in++;
+    }
+#undef PUT_LIT
+    st->code_buffer = (GLZWUint)acc & 0xFF;
+    st->buf_bits_left = 8 - nbits;
+    st->head = head;
+    st->next_code = next_code;
+    st->lit_left = lit_left;
+    *in_avail -= in - *pin;
+    *out_avail -= out - *pout;
+    *pin = in;
+    *pout = out;
+}
+
+static int glzwe_codes(Glzwe_state *st, const GLZWByte *in_ptr,
+        GLZWByte *out_ptr, GLZWUint *in_avail, GLZWUint *out_avail,
+        GLZWUint end_of_data)
+{
+    if (st->la_buf && !st->lit_on)
+        return glzwe_la(st, in_ptr, out_ptr, in_avail, out_avail,
+                                                            end_of_data);
     switch (st->entry_state) {
 
     case LZW_TRY_IN1:
@@ -70,9 +628,17 @@ get_first_byte:
         }
         st->head = *in_ptr++;
         (*in_avail)--;
+        st->in_count++;
 
     case LZW_TRY_IN2:
 encode_loop:
+        if (*in_avail >= BULK_MIN_IN &&
+                                *out_avail + st->out_slack >= BULK_MIN_OUT) {
+            if (st->lit_on)
+                glzwe_lit(st, &in_ptr, &out_ptr, in_avail, out_avail);
+            else
+                glzwe_bulk(st, &in_ptr, &out_ptr, in_avail, out_avail);
+        }
         if (!*in_avail) {
             if (end_of_data) {
                 st->code = st->head;
@@ -84,16 +650,39 @@ encode_loop:
         }
         st->tail = *in_ptr++;
         (*in_avail)--;
+        st->in_count++;
 
-        /* Knuth TAOCP vol 3 algorithm D. */
-        /* Hashes found experimentally to be pretty good: */
-#if FASTER_HASH
-        /* This works ONLY with TABLE_SIZE a power of 2: */
-        st->probe = ((st->head ^ (st->tail << 6)) * 31) & (TABLE_SIZE - 1);
-#else
-        st->probe = (st->head * 211 + st->tail * 17) % TABLE_SIZE;
+        if (st->lit_on) {
+            /* Masked only to keep bad input in bounds. */
+            st->code = st->head & (st->clear_code - 1);
+            st->put_state = PUT_LITERAL;
+            goto put_code;
+        }
+
+        if (st->child) {
+            /* Tail is masked only to keep bad input in bounds. */
+            st->probe = (st->head << st->lzw_min_code_width) |
+                                    (st->tail & (st->clear_code - 1));
+            st->code = st->child[st->probe];
+            if (st->code < st->next_code &&
+                        st->key[st->code] == ((st->head << 8) | st->tail)) {
+#ifdef TESTDEV
+nsuccesses++;
 #endif
-        while (st->codes[st->probe]) {
+                st->head = st->code;
+                goto encode_loop;
+            }
+#ifdef TESTDEV
+nfails++;
+#endif
+            st->code = st->head;
+            st->put_state = PUT_HEAD;
+            goto put_code;
+        }
+
+        /* Knuth TAOCP vol 3 algorithm D. */
+        st->probe = HASH(st, st->head, st->tail);
+        while (st->epochs[st->probe] == st->epoch) {
             if ((st->codes[st->probe] & 0xFFFFF) ==
                                         ((st->head << 8) | st->tail)) {
 #ifdef TESTDEV
@@ -105,17 +694,9 @@ nsuccesses++;
 #ifdef TESTDEV
 nreprobes++;
 #endif
-        /* reprobe decrement must be nonzero and relatively prime to table
-         * size. These decrements found experimentally to be pretty good. */
-#if FASTER_HASH
-                if ((st->probe -= ((st->tail << 2) | 1)) < 0) {
-                    st->probe += TABLE_SIZE;
-                }
-#else
-                if ((st->probe -= (st->tail + 1)) < 0) {
-                    st->probe += TABLE_SIZE;
+                if ((st->probe -= REPROBE(st, st->tail)) < 0) {
+                    st->probe += SLOTS(st);
                 }
-#endif
             }
         }
         /* Key not found, probe is at empty slot. */
@@ -130,14 +711,25 @@ insert_code_or_clear: /* jump here after put_code */
 #ifdef TESTDEV
 ninserts++;
 #endif
-            st->codes[st->probe] = (st->next_code << 20) |
-                                    (st->head << 8) | st->tail;
+            if (st->child) {
+                st->child[st->probe] = st->next_code;
+                st->key[st->next_code] = (st->head << 8) | st->tail;
+            } else {
+                st->codes[st->probe] = (st->next_code << 20) |
+                                        (st->head << 8) | st->tail;
+                st->epochs[st->probe] = st->epoch;
+                if (st->runs && st->run_last[st->tail] == st->head) {
+                    st->run_next[st->head] = st->next_code;
+                    st->run_last[st->tail] = st->next_code;
+                    st->run_len[st->tail]++;
+                }
+            }
             if (st->next_code > st->max_code) {
                 st->max_code = st->max_code * 2 + 1;
                 st->code_width++;
             }
             st->next_code++;
-        } else {
+        } else if (literal_due(st) || clear_due(st)) {
             st->code = st->clear_code;
             st->put_state = PUT_CLEAR;
             goto put_code;
@@ -146,6 +738,17 @@ reset_after_clear: /* jump here after put_code */
         }
         st->head = st->tail;
         goto encode_loop;
+literal_done: /* jump here after put_code */
+        if (st->lit_left)
+            st->lit_left--;
+        if (st->next_code < st->max_code) {
+            st->next_code++;
+            st->head = st->tail;
+            goto encode_loop;
+        }
+        st->code = st->clear_code;
+        st->put_state = PUT_CLEAR;
+        goto put_code;
 
     case LZW_INITIAL:
         glzwe_reset(st);
@@ -156,6 +759,23 @@ put_code:
 #ifdef TESTDEV
 if (print_enc_codes) printf("enc code: %d\n", st->code);
 #endif
+        st->out_bits += st->code_width;
+        if (*out_avail >= 8) {
+            /* Append the whole code to the pending bits and store them
+             * with one 8-byte write.  Bytes completed by this code are
+             * output, except that a last full byte is kept pending, as in
+             * the byte at a time path below. */
+            GLZWUint bits = 8 - st->buf_bits_left + st->code_width;
+            GLZWUint nbytes = (bits - 1) >> 3;
+            Bitbuf acc = st->code_buffer |
+                            (Bitbuf)st->code << (8 - st->buf_bits_left);
+            store_le64(out_ptr, acc);
+            out_ptr += nbytes;
+            *out_avail -= nbytes;
+            st->code_buffer = (GLZWUint)(acc >> (8 * nbytes)) & 0xFF;
+            st->buf_bits_left = 8 * (nbytes + 1) - bits;
+            goto put_done;
+        }
         st->code_bits_left = st->code_width;
 check_buf_bits:
         if (!st->buf_bits_left) {   /* out buffer full */
@@ -180,6 +800,7 @@ check_buf_bits:
         st->code_bits_left -= n;
         if (st->code_bits_left)
             goto check_buf_bits;
+put_done:
         switch (st->put_state) {
         case PUT_INIT_CLEAR:
             goto get_first_byte;
@@ -191,11 +812,17 @@ check_buf_bits:
             goto end_of_data;
         case PUT_END:
             goto flush_code_buffer;
+        case PUT_LITERAL:
+            goto literal_done;
         default:
             return GLZW_INTERNAL_ERROR;
         }
 
 end_of_data:
+        /* The decoder adds an entry for the last code, which may make the
+         * END code a bit wider. */
+        if (st->next_code > st->max_code && st->next_code < CODE_LIMIT)
+            st->code_width++;
         st->code = st->end_code;
         st->put_state = PUT_END;
         goto put_code;
@@ -221,7 +848,165 @@ flush_code_buffer: /* jump here after put_code */
     }
 }
 
+/* glzwe() with GLZWE_OPT_SUBBLOCKS.  With room for a whole sub-block,
+ * the codes are written straight to the output, after its count byte.
+ * If the input runs out before the sub-block is full, its bytes so far
+ * are kept in sb_buf, and put back in front of the next ones.  With less
+ * room, the sub-block is made in sb_buf and copied out as room allows. */
+static int glzwe_sub(Glzwe_state *st, const GLZWByte *in_ptr,
+        GLZWByte *out_ptr, GLZWUint *in_avail, GLZWUint *out_avail,
+        GLZWUint end_of_data)
+{
+    GLZWUint avail, n;
+    int r;
+    for (;;) {
+        switch (st->sb_state) {
+        case SB_FLUSH:
+        case SB_FLUSH_LAST:
+            n = st->sb_len + 1 - st->sb_pos;
+            if (n > *out_avail)
+                n = *out_avail;
+            memcpy(out_ptr, st->sb_buf + st->sb_pos, n);
+            out_ptr += n;
+            *out_avail -= n;
+            st->sb_pos += n;
+            if (st->sb_pos <= st->sb_len)
+                return GLZW_NO_OUTPUT_AVAIL;
+            st->sb_len = st->sb_pos = 0;
+            st->sb_state = st->sb_state == SB_FLUSH ? SB_FILL : SB_TERMINATE;
+            continue;
+        case SB_TERMINATE:
+            if (!*out_avail)
+                return GLZW_NO_OUTPUT_AVAIL;
+            *out_ptr = 0;
+            (*out_avail)--;
+            st->sb_state = SB_DONE;
+        case SB_DONE:
+            return GLZW_OK;
+        }
+
+        avail = *in_avail;
+        if (*out_avail > 255) {
+            memcpy(out_ptr + 1, st->sb_buf + 1, st->sb_len);
+            n = 255 - st->sb_len;
+            /* The next sub-block's room is free to store into. */
+            st->out_slack = *out_avail >= 256 + SUB_SLACK ? SUB_SLACK : 0;
+            r = glzwe_codes(st, in_ptr, out_ptr + 1 + st->sb_len, in_avail,
+                                                        &n, end_of_data);
+            st->out_slack = 0;
+            in_ptr += avail - *in_avail;
+            n = 255 - n;
+            if (n < 255 && r != GLZW_OK) {
+                memcpy(st->sb_buf + 1, out_ptr + 1, n);
+                st->sb_len = n;
+                return r == GLZW_NO_INPUT_AVAIL ? r : GLZW_INTERNAL_ERROR;
+            }
+            st->sb_len = 0;
+            if (n) {
+                *out_ptr = (GLZWByte)n;
+                out_ptr += n + 1;
+                *out_avail -= n + 1;
+            }
+            if (r == GLZW_OK)
+                st->sb_state = SB_TERMINATE;
+        } else {
+            n = 255 - st->sb_len;
+            r = glzwe_codes(st, in_ptr, st->sb_buf + 1 + st->sb_len, in_avail,
+                                                        &n, end_of_data);
+            in_ptr += avail - *in_avail;
+            st->sb_len = 255 - n;
+            if (st->sb_len < 255 && r != GLZW_OK)
+                return r == GLZW_NO_INPUT_AVAIL ? r : GLZW_INTERNAL_ERROR;
+            st->sb_buf[0] = (GLZWByte)st->sb_len;
+            st->sb_state = r == GLZW_OK ? SB_FLUSH_LAST : SB_FLUSH;
+            if (!st->sb_len)
+                st->sb_state = SB_TERMINATE;
+        }
+    }
+}
+
+int glzwe(void *state, const GLZWByte *in_ptr, GLZWByte *out_ptr,
+        GLZWUint *in_avail, GLZWUint *out_avail,
+        GLZWUint end_of_data)
+{
+    Glzwe_state *st = (Glzwe_state *)state;
+    if (st->sb_on)
+        return glzwe_sub(st, in_ptr, out_ptr, in_avail, out_avail,
+                                                            end_of_data);
+    return glzwe_codes(st, in_ptr, out_ptr, in_avail, out_avail,
+                                                            end_of_data);
+}
+
+/* Options can only be changed before the first call to glzwe(). */
+int glzwe_set_option(void *state, GLZWUint option, GLZWUint value)
+{
+    Glzwe_state *st = (Glzwe_state *)state;
+    GLZWUint c;
+    if (st->entry_state != LZW_INITIAL)
+        return GLZW_INVALID_OPTION;
+    switch (option) {
+    case GLZWE_OPT_CLEAR:
+        if (value > GLZWE_CLEAR_RATIO)
+            return GLZW_INVALID_OPTION;
+        st->clear_policy = value;
+        return GLZW_OK;
+    case GLZWE_OPT_TABLE:
+        if (value > GLZWE_TABLE_PRIME)
+            return GLZW_INVALID_OPTION;
+        st->table = value;
+        return GLZW_OK;
+    case GLZWE_OPT_SUBBLOCKS:
+        st->sb_on = value != 0;
+        return GLZW_OK;
+    case GLZWE_OPT_RUNS:
+        st->runs = value != 0;
+        reset_runs(st);
+        return GLZW_OK;
+    case GLZWE_OPT_PREDICT:
+        st->predict = value != 0;
+        return GLZW_OK;
+    case GLZWE_OPT_LITERAL:
+        if (value > GLZWE_LITERAL_AUTO)
+            return GLZW_INVALID_OPTION;
+        st->lit_mode = value;
+        st->lit_on = value == GLZWE_LITERAL_ALWAYS;
+        return GLZW_OK;
+    case GLZWE_OPT_LOOKAHEAD:
+        if (value && !st->la_buf) {
+            st->la_buf = (GLZWByte *)malloc(LA_BUF_SIZE);
+            if (!st->la_buf)
+                return GLZW_OUT_OF_MEMORY;
+        } else if (!value) {
+            free(st->la_buf);
+            st->la_buf = NULL;
+        }
+        st->la_span = value;
+        return GLZW_OK;
+    case GLZWE_OPT_DENSE:
+        if (value && !st->child) {
+            /* key[] and child[] in one block; roots never match a key. */
+            st->key = (GLZWUint *)calloc(1, CODE_LIMIT * sizeof(GLZWUint) +
+                (CODE_LIMIT << st->lzw_min_code_width) * sizeof(GLZWUshort));
+            if (!st->key)
+                return GLZW_OUT_OF_MEMORY;
+            st->child = (GLZWUshort *)(st->key + CODE_LIMIT);
+            for (c = 0; c <= st->end_code; c++)
+                st->key[c] = ~0u;
+        } else if (!value) {
+            free(st->key);
+            st->key = NULL;
+            st->child = NULL;
+        }
+        return GLZW_OK;
+    default:
+        return GLZW_INVALID_OPTION;
+    }
+}
+
 void glzwe_end(void *state)
 {
+    Glzwe_state *st = (Glzwe_state *)state;
+    free(st->key);
+    free(st->la_buf);
     free(state);
 }
@@ -4,6 +4,7 @@
 
 typedef unsigned char GLZWByte;
 typedef unsigned int GLZWUint;
+typedef unsigned short GLZWUshort;
 
 /* Return values */
 #define GLZW_OK                 0
@@ -11,6 +12,32 @@ typedef unsigned int GLZWUint;
 #define GLZW_NO_OUTPUT_AVAIL    2
 #define GLZW_OUT_OF_MEMORY      3
 #define GLZW_INTERNAL_ERROR     4
+#define GLZW_INVALID_DATA       5
+#define GLZW_INVALID_OPTION     6
+
+/* Options for glzwe_set_option() */
+#define GLZWE_OPT_DENSE         1
+#define GLZWE_OPT_CLEAR         2
+#define GLZWE_OPT_LOOKAHEAD     3
+#define GLZWE_OPT_TABLE         4
+#define GLZWE_OPT_SUBBLOCKS     5
+#define GLZWE_OPT_LITERAL       6
+#define GLZWE_OPT_RUNS          7
+#define GLZWE_OPT_PREDICT       8
+
+/* Values for GLZWE_OPT_CLEAR */
+#define GLZWE_CLEAR_FULL        0   /* CLEAR when the table fills */
+#define GLZWE_CLEAR_NEVER       1   /* keep the full table to the end */
+#define GLZWE_CLEAR_RATIO       2   /* CLEAR when compression gets worse */
+
+/* Values for GLZWE_OPT_LITERAL */
+#define GLZWE_LITERAL_OFF       0   /* LZW codes */
+#define GLZWE_LITERAL_ALWAYS    1   /* every byte a literal code */
+#define GLZWE_LITERAL_AUTO      2   /* literal codes while LZW gains nothing */
+
+/* Values for GLZWE_OPT_TABLE */
+#define GLZWE_TABLE_POW2        0   /* 8192 slots, shift and xor hash */
+#define GLZWE_TABLE_PRIME       1   /* 4801 slots, mod hash */
 
 /* Table load factors: with max load of 3838 (=4096-256-2), these table sizes
  * will give these load factors (lower factor means fewer reprobes).  Primes
@@ -18,12 +45,10 @@ typedef unsigned int GLZWUint;
  * have good hash function if using mod tablesize (== use lower bits of hash).
  * 4096 .937; 4801 .799; 5101 .752; 6829 .562; 8221 .467; 8192 .469 */
 
+/* The default table: 1 for GLZWE_TABLE_POW2, 0 for GLZWE_TABLE_PRIME.  The
+ * arrays are big enough for either. */
 #define FASTER_HASH  1
-#if FASTER_HASH
 #define TABLE_SIZE  8192
-#else
-#define TABLE_SIZE  4801
-#endif
 
 typedef struct Glzwe_state {
     GLZWUint put_state;
@@ -35,7 +60,51 @@ typedef struct Glzwe_state {
     GLZWUint head, tail;
     int probe;
     GLZWUint code;
+    GLZWUint table;         /* GLZWE_OPT_TABLE */
     GLZWUint codes[TABLE_SIZE];
+    /* A slot is empty unless its epochs[] entry is the current epoch. */
+    GLZWByte epochs[TABLE_SIZE];
+    GLZWUint epoch;
+    /* GLZWE_OPT_RUNS: for runs of one byte b, run_last[b] is the code for
+     * the longest string of b's added since the last CLEAR, if each was
+     * added to the one before it; run_len[b] is how many codes past b that
+     * is, and run_next[c] is the code for c's string and one more b, for
+     * each c on the way. */
+    GLZWUint runs;
+    GLZWUshort run_next[4096];
+    GLZWUshort run_last[256], run_len[256];
+    /* GLZWE_OPT_PREDICT: pred[head] is the child of head found last,
+     * (code << 16) | (epoch << 8) | tail, and how often the main loop
+     * found (pred_hits) or did not find (pred_misses) the child there. */
+    GLZWUint predict;
+    GLZWUint pred[4096];
+    unsigned long pred_hits, pred_misses;
+    /* GLZWE_OPT_DENSE: child[head << lzw_min_code_width | tail] is the code
+     * for head + tail if key[code] is (head << 8) | tail. */
+    GLZWUint *key;
+    GLZWUshort *child;
+    /* GLZWE_OPT_CLEAR, and for GLZWE_CLEAR_RATIO the input bytes and output
+     * bits since the last CLEAR or check, and the ratio when the table
+     * filled. */
+    GLZWUint clear_policy;
+    GLZWUint in_count, out_bits, ratio;
+    /* GLZWE_OPT_LOOKAHEAD: the shorter strings to try, buffered input,
+     * the last code written (CODE_LIMIT if none since a CLEAR), and output
+     * not yet copied out. */
+    GLZWByte *la_buf;
+    GLZWUint la_span, la_len, la_pos, la_prev;
+    GLZWByte la_out[8];
+    GLZWUint la_out_len, la_out_pos;
+    /* GLZWE_OPT_SUBBLOCKS: sub-block output state, and a sub-block not yet
+     * written out: sb_buf[0] is its count, and sb_len bytes follow, of
+     * which sb_pos (counting the count byte) have been written. */
+    GLZWUint sb_on, sb_state, sb_len, sb_pos;
+    GLZWByte sb_buf[256];
+    /* Bytes past *out_avail that glzwe_bulk() may store into. */
+    GLZWUint out_slack;
+    /* GLZWE_OPT_LITERAL: the mode, whether literal codes are being written
+     * now, and for GLZWE_LITERAL_AUTO how many more bytes to write so. */
+    GLZWUint lit_mode, lit_on, lit_left;
 } Glzwe_state;
 
 int glzwe_init(void **pstate, const GLZWUint lzw_min_code_width);
@@ -44,4 +113,6 @@ int glzwe(void *state, const GLZWByte *in_ptr, GLZWByte *out_ptr,
         GLZWUint *in_avail, GLZWUint *out_avail,
         GLZWUint end_of_data);
 
+int glzwe_set_option(void *state, GLZWUint option, GLZWUint value);
+
 void glzwe_end(void *state);
@@ -0,0 +1,215 @@
+/* glzwe_bulk.h -- GIF LZW encoder main loop, included by glzwe.c once for
+ * each table configuration
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+/* Define before including:
+ *   BULK_NAME          name of the function
+ * and either, for the dense table (GLZWE_OPT_DENSE),
+ *   BULK_MCW           lzw_min_code_width
+ * or, for a hash table,
+ *   BULK_HASH(head, tail), BULK_REPROBE(tail), BULK_TABLE_SIZE
+ *   and optionally BULK_RUNS for GLZWE_OPT_RUNS and BULK_PREDICT for
+ *   GLZWE_OPT_PREDICT
+ * They are undefined at the end. */
+
+/* Encode while there is input and room for output, with the state in
+ * locals.  Entered and left at encode_loop, with head the string so far.
+ * Codes are added to a bit buffer and stored 8 bytes at a time, as in
+ * put_code. */
+static void BULK_NAME(Glzwe_state *st, const GLZWByte **pin,
+        GLZWByte **pout, GLZWUint *in_avail, GLZWUint *out_avail)
+{
+    const GLZWByte *in = *pin, *in_end = in + *in_avail, *in_mark = in;
+    GLZWByte *out = *pout;
+    GLZWByte *out_lim = out + *out_avail + st->out_slack - BULK_MIN_OUT;
+    GLZWUint head = st->head, tail, key;
+    GLZWUint next_code = st->next_code, max_code = st->max_code;
+    GLZWUint code_width = st->code_width, epoch = st->epoch;
+#ifdef BULK_MCW
+    GLZWUint code, *keys = st->key;
+    GLZWUshort *child = st->child;
+#else
+    GLZWUint *codes = st->codes;
+    GLZWByte *epochs = st->epochs;
+#endif
+#ifdef BULK_RUNS
+    GLZWUshort *run_next = st->run_next, *run_last = st->run_last;
+    GLZWUint n;
+#endif
+#ifdef BULK_PREDICT
+    GLZWUint *pred = st->pred, entry;
+    GLZWUint pred_hits = 0, pred_misses = 0;
+#endif
+    Bitbuf acc = st->code_buffer;
+    GLZWUint nbits = 8 - st->buf_bits_left, out_bits = st->out_bits;
+    int probe, keep;
+
+    while (in < in_end && out <= out_lim) {
+        tail = *in++;
+        key = (head << 8) | tail;
+#ifdef BULK_MCW
+        /* Tail is masked only to keep bad input in bounds. */
+        probe = (head << BULK_MCW) | (tail & ((1 << BULK_MCW) - 1));
+        code = child[probe];
+        if (code < next_code && keys[code] == key) {
+#ifdef TESTDEV
+nsuccesses++;
+#endif
+            head = code;
+            continue;
+        }
+#else
+#ifdef BULK_PREDICT
+        /* Try the child of head found last, if it was for this tail. */
+        entry = pred[head];
+        if ((entry & 0xFFFF) == (epoch << 8 | tail)) {
+#ifdef TESTDEV
+nsuccesses++;
+#endif
+            pred_hits++;
+            head = entry >> 16;
+            continue;
+        }
+        pred_misses++;
+#endif
+        probe = BULK_HASH(head, tail);
+        while (epochs[probe] == epoch) {
+            if ((codes[probe] & 0xFFFFF) == key)
+                break;
+#ifdef TESTDEV
+nreprobes++;
+#endif
+            if ((probe -= BULK_REPROBE(tail)) < 0)
+                probe += BULK_TABLE_SIZE;
+        }
+        if (epochs[probe] == epoch) {
+#ifdef TESTDEV
+nsuccesses++;
+#endif
+#ifdef BULK_PREDICT
+            pred[head] = codes[probe] >> 20 << 16 | epoch << 8 | tail;
+#endif
+            head = codes[probe] >> 20;
+            continue;
+        }
+#endif
+#ifdef TESTDEV
+nfails++;
+if (print_enc_codes) printf("enc code: %d\n", head);
+#endif
+        acc |= (Bitbuf)head << nbits;
+        nbits += code_width;
+        out_bits += code_width;
+        store_le64(out, acc);
+        out += nbits >> 3;
+        acc >>= nbits & ~7;
+        nbits &= 7;
+        if (next_code < CODE_LIMIT) {
+#ifdef TESTDEV
+ninserts++;
+#endif
+#ifdef BULK_MCW
+            child[probe] = next_code;
+            keys[next_code] = key;
+#else
+            codes[probe] = (next_code << 20) | key;
+            epochs[probe] = epoch;
+#endif
+#ifdef BULK_PREDICT
+            pred[head] = next_code << 16 | epoch << 8 | tail;
+#endif
+#ifdef BULK_RUNS
+            if (run_last[tail] == head) {
+                run_next[head] = next_code;
+                run_last[tail] = next_code;
+                st->run_len[tail]++;
+            }
+#endif
+            if (next_code > max_code) {
+                max_code = max_code * 2 + 1;
+                code_width++;
+            }
+            next_code++;
+        } else {
+            /* literal_due() and clear_due() use, and clear_due() may
+             * change, the counts. */
+            st->in_count += in - in_mark;
+            in_mark = in;
+            st->out_bits = out_bits;
+            if (!literal_due(st) && st->clear_policy != GLZWE_CLEAR_FULL) {
+                keep = !clear_due(st);
+                out_bits = st->out_bits;
+                if (keep) {
+                    head = tail;
+                    continue;
+                }
+            }
+#ifdef TESTDEV
+if (print_enc_codes) printf("enc code: %d\n", st->clear_code);
+#endif
+            acc |= (Bitbuf)st->clear_code << nbits;
+            nbits += code_width;
+            store_le64(out, acc);
+            out += nbits >> 3;
+            acc >>= nbits & ~7;
+            nbits &= 7;
+            st->epoch = epoch;
+            glzwe_reset(st);
+            next_code = st->next_code;
+            max_code = st->max_code;
+            code_width = st->code_width;
+            epoch = st->epoch;
+            /* The input before this point is in the last block. */
+            in_mark = in;
+            out_bits = 0;
+            if (st->lit_on) {
+                /* GLZWE_LITERAL_AUTO: glzwe_lit() goes on from here. */
+                head = tail;
+                break;
+            }
+        }
+        head = tail;
+#ifdef BULK_RUNS
+        /* A run of head's byte follows: take the codes for longer runs
+         * from run_next[] instead of the hash table, as far as the run and
+         * the codes go. */
+        if (in < in_end && *in == head && (n = st->run_len[head]) != 0) {
+            if (n > (GLZWUint)(in_end - in))
+                n = (GLZWUint)(in_end - in);
+            n = run_length(in, n, head);
+            in += n;
+#ifdef TESTDEV
+nsuccesses += n;
+#endif
+            while (n--)
+                head = run_next[head];
+        }
+#endif
+    }
+    /* Leave a partial byte pending, or none. */
+    st->code_buffer = (GLZWUint)acc & 0xFF;
+    st->buf_bits_left = 8 - nbits;
+    st->head = head;
+    st->next_code = next_code;
+    st->max_code = max_code;
+    st->code_width = code_width;
+    st->in_count += in - in_mark;
+    st->out_bits = out_bits;
+#ifdef BULK_PREDICT
+    st->pred_hits += pred_hits;
+    st->pred_misses += pred_misses;
+#endif
+    *in_avail -= in - *pin;
+    *out_avail -= out - *pout;
+    *pin = in;
+    *pout = out;
+}
+
+#undef BULK_NAME
+#undef BULK_MCW
+#undef BULK_HASH
+#undef BULK_REPROBE
+#undef BULK_TABLE_SIZE
+#undef BULK_RUNS
+#undef BULK_PREDICT
@@ -0,0 +1,209 @@
+/* glzwep.c -- GIF LZW parallel encoder
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+/* string.h for memcpy()/memset(); stdlib.h for malloc()/free(). */
+#include <string.h>
+#include <stdlib.h>
+
+#include "glzwe.h"
+#include "glzwep.h"
+#define GLZW_LOAD_LE64
+#define GLZW_STORE_LE64
+#define GLZW_RUN_JOBS
+#include "glzwint.h"
+
+/* One segment's stream, as written by glzwe(): a CLEAR code, the codes,
+ * and an END code, end_width bits wide. */
+typedef struct Segment {
+    GLZWByte *buf;
+    GLZWUint bits, end_width;
+} Segment;
+
+/* A run of segments encoded on one thread. */
+typedef struct Encode_job {
+    const GLZWByte *in_ptr;
+    GLZWUint in_len, segment_size, lzw_min_code_width;
+    Segment *seg;
+    GLZWUint nseg;
+    int ret;
+} Encode_job;
+
+/* Output being written bit by bit, as by the encoder's put_code. */
+typedef struct Splice {
+    GLZWByte *out, *out_end;
+    Bitbuf acc;
+    GLZWUint nbits;
+} Splice;
+
+/* Room for glzwe() to encode n bytes: a code of at most 12 bits for each
+ * byte, a CLEAR for at most every 3838 codes, the first CLEAR and END,
+ * and 8 bytes more so the output can be read 8 bytes at a time. */
+static size_t max_output(GLZWUint n)
+{
+    return (size_t)n + n / 2 + n / 2048 + 16;
+}
+
+/* Encode each segment of a run with its own glzwe() state. */
+static void encode_run(void *arg)
+{
+    Encode_job *job = (Encode_job *)arg;
+    const GLZWByte *in = job->in_ptr;
+    GLZWUint left = job->in_len, k, n, in_avail, out_avail;
+    Glzwe_state *st;
+    void *state;
+    Segment *seg;
+    size_t size;
+
+    job->ret = GLZW_OK;
+    for (k = 0; k < job->nseg; k++) {
+        seg = &job->seg[k];
+        n = left < job->segment_size ? left : job->segment_size;
+        size = max_output(n);
+        seg->buf = (GLZWByte *)malloc(size);
+        if (!seg->buf) {
+            job->ret = GLZW_OUT_OF_MEMORY;
+            return;
+        }
+        job->ret = glzwe_init(&state, job->lzw_min_code_width);
+        if (job->ret)
+            return;
+        st = (Glzwe_state *)state;
+        in_avail = n;
+        out_avail = (GLZWUint)size - 8;
+        job->ret = glzwe(st, in, seg->buf, &in_avail, &out_avail, 1);
+        if (job->ret) {
+            glzwe_end(st);
+            job->ret = GLZW_INTERNAL_ERROR;
+            return;
+        }
+        in += n;
+        left -= n;
+        /* The last byte has buf_bits_left unused bits, or none if 8. */
+        n = (GLZWUint)size - 8 - out_avail;
+        seg->bits = 8 * n - (st->buf_bits_left & 7);
+        seg->end_width = st->code_width;
+        /* Zeros for put_stream() to read past the end. */
+        memset(seg->buf + n, 0, 8);
+        glzwe_end(st);
+    }
+}
+
+/* Append the low nbits (at most 56) of v. */
+static void put_bits(Splice *sp, Bitbuf v, GLZWUint nbits)
+{
+    sp->acc |= (v & (((Bitbuf)1 << nbits) - 1)) << sp->nbits;
+    sp->nbits += nbits;
+    if (sp->out_end - sp->out >= 8) {
+        store_le64(sp->out, sp->acc);
+        sp->out += sp->nbits >> 3;
+        sp->acc >>= sp->nbits & ~7;
+        sp->nbits &= 7;
+    } else {
+        while (sp->nbits >= 8) {
+            *sp->out++ = (GLZWByte)sp->acc;
+            sp->acc >>= 8;
+            sp->nbits -= 8;
+        }
+    }
+}
+
+/* Append bits from up to (not including) to of buf. */
+static void put_stream(Splice *sp, const GLZWByte *buf, GLZWUint from,
+        GLZWUint to)
+{
+    while (to - from > 56) {
+        put_bits(sp, load_le64(buf + (from >> 3)) >> (from & 7), 56);
+        from += 56;
+    }
+    put_bits(sp, load_le64(buf + (from >> 3)) >> (from & 7), to - from);
+}
+
+/* Encode a whole input buffer into one LZW stream on several threads.  The
+ * input is cut into segments of segment_size bytes, and each is encoded by
+ * glzwe() with its own state, starting with a CLEAR code, so they do not
+ * depend on each other.  Then they are joined: each segment's END code is
+ * replaced by a CLEAR code of the same width, which the decoder expects at
+ * that point, and the CLEAR code that started the next segment, which was
+ * written with the initial width, is dropped.  The segments are split into
+ * nthreads runs of about the same number.  segment_size 0 gives one
+ * segment per thread.
+ *
+ * Returns GLZW_OK, or GLZW_NO_OUTPUT_AVAIL if the stream does not fit, in
+ * which case nothing is written.  On success *out_avail is reduced by the
+ * bytes written.
+ */
+int glzwep(const GLZWByte *in_ptr, GLZWUint in_avail,
+        GLZWUint lzw_min_code_width, GLZWByte *out_ptr, GLZWUint *out_avail,
+        GLZWUint segment_size, GLZWUint nthreads)
+{
+    Encode_job jobs[MAX_THREADS];
+    Segment *seg;
+    GLZWUint nseg, first, t, k, clear_code = 1 << lzw_min_code_width;
+    GLZWUint init_width = lzw_min_code_width + 1;
+    unsigned long long total;
+    Splice sp;
+    int ret = GLZW_OK;
+
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    if (!segment_size)
+        segment_size = in_avail / nthreads + 1;
+    nseg = in_avail ? (in_avail - 1) / segment_size + 1 : 1;
+    if (nthreads > nseg)
+        nthreads = nseg;
+    seg = (Segment *)calloc(nseg, sizeof(Segment));
+    if (!seg)
+        return GLZW_OUT_OF_MEMORY;
+    for (t = 0, first = 0; t < nthreads; t++) {
+        k = (GLZWUint)((unsigned long long)nseg * (t + 1) / nthreads);
+        jobs[t].in_ptr = in_ptr + (size_t)first * segment_size;
+        jobs[t].in_len = k < nseg ? (k - first) * segment_size :
+                                    in_avail - first * segment_size;
+        jobs[t].segment_size = segment_size;
+        jobs[t].lzw_min_code_width = lzw_min_code_width;
+        jobs[t].seg = seg + first;
+        jobs[t].nseg = k - first;
+        first = k;
+    }
+    run_jobs(encode_run, jobs, sizeof(jobs[0]), nthreads);
+    for (t = 0; t < nthreads; t++)
+        if (jobs[t].ret)
+            ret = jobs[t].ret;
+    if (ret)
+        goto done;
+
+    /* Each join drops a CLEAR and an END and adds a CLEAR. */
+    total = 0;
+    for (k = 0; k < nseg; k++)
+        total += seg[k].bits;
+    total -= (unsigned long long)(nseg - 1) * init_width;
+    if ((total + 7) / 8 > *out_avail) {
+        ret = GLZW_NO_OUTPUT_AVAIL;
+        goto done;
+    }
+    sp.out = out_ptr;
+    sp.out_end = out_ptr + *out_avail;
+    sp.acc = 0;
+    sp.nbits = 0;
+    for (k = 0; k < nseg; k++) {
+        if (k < nseg - 1) {
+            put_stream(&sp, seg[k].buf, k ? init_width : 0,
+                                        seg[k].bits - seg[k].end_width);
+            put_bits(&sp, clear_code, seg[k].end_width);
+        } else {
+            put_stream(&sp, seg[k].buf, k ? init_width : 0, seg[k].bits);
+        }
+    }
+    if (sp.nbits)
+        *sp.out++ = (GLZWByte)sp.acc;
+    *out_avail -= sp.out - out_ptr;
+
+done:
+    for (k = 0; k < nseg; k++)
+        free(seg[k].buf);
+    free(seg);
+    return ret;
+}
@@ -0,0 +1,107 @@
+/* glzwint.h -- helpers shared by the glzw*.c files; not for applications
+ * Copyright 2021 Raymond D. Gardner
+ */
+
+/* Define before including, for the helpers wanted:
+ *   GLZW_LOAD_LE64     load_le64()
+ *   GLZW_STORE_LE64    store_le64()
+ *   GLZW_RUN_JOBS      run_jobs(), Job_fn and MAX_THREADS
+ * so that no file gets an unused static function. */
+
+#ifndef GLZWINT_H
+#define GLZWINT_H
+
+#if defined(GLZW_LOAD_LE64) || defined(GLZW_STORE_LE64)
+/* string.h for memcpy(). */
+#include <string.h>
+
+typedef unsigned long long Bitbuf;
+#endif
+
+#ifdef GLZW_LOAD_LE64
+/* Load 8 bytes as a little-endian value. */
+static Bitbuf load_le64(const GLZWByte *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+        || defined(_M_IX86) || defined(_M_X64)
+    Bitbuf v;
+    memcpy(&v, p, 8);
+    return v;
+#else
+    return (Bitbuf)p[0] | (Bitbuf)p[1] << 8 | (Bitbuf)p[2] << 16 |
+        (Bitbuf)p[3] << 24 | (Bitbuf)p[4] << 32 | (Bitbuf)p[5] << 40 |
+        (Bitbuf)p[6] << 48 | (Bitbuf)p[7] << 56;
+#endif
+}
+#endif
+
+#ifdef GLZW_STORE_LE64
+/* Store 8 bytes as a little-endian value. */
+static void store_le64(GLZWByte *p, Bitbuf v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+        || defined(_M_IX86) || defined(_M_X64)
+    memcpy(p, &v, 8);
+#else
+    int k;
+    for (k = 0; k < 8; k++)
+        p[k] = (GLZWByte)(v >> (8 * k));
+#endif
+}
+#endif
+
+#ifdef GLZW_RUN_JOBS
+#ifdef GLZW_THREADS
+#include <pthread.h>
+#endif
+
+/* Most threads used. */
+#define MAX_THREADS     64
+
+typedef void (*Job_fn)(void *job);
+
+#ifdef GLZW_THREADS
+typedef struct Thread_arg {
+    Job_fn fn;
+    void *job;
+} Thread_arg;
+
+static void *thread_main(void *arg)
+{
+    Thread_arg *ta = (Thread_arg *)arg;
+    ta->fn(ta->job);
+    return NULL;
+}
+#endif
+
+/* Run fn() on each of n jobs, each job_size bytes, on separate threads
+ * if possible, or else one after another.  The threads are created for
+ * this call and joined before it returns; none are kept between calls. */
+static void run_jobs(Job_fn fn, void *jobs, size_t job_size, GLZWUint n)
+{
+    GLZWUint t;
+#ifdef GLZW_THREADS
+    pthread_t tid[MAX_THREADS];
+    Thread_arg ta[MAX_THREADS];
+    GLZWUint started = 1;
+
+    for (t = 1; t < n; t++, started++) {
+        ta[t].fn = fn;
+        ta[t].job = (char *)jobs + t * job_size;
+        if (pthread_create(&tid[t], NULL, thread_main, &ta[t]))
+            break;
+    }
+    /* Do any that could not be started here. */
+    for (t = started; t < n; t++)
+        fn((char *)jobs + t * job_size);
+    fn(jobs);
+    for (t = 1; t < started; t++)
+        pthread_join(tid[t], NULL);
+#else
+    for (t = 0; t < n; t++)
+        fn((char *)jobs + t * job_size);
+#endif
+}
+#endif
+
+#endif
@@ -21,6 +21,7 @@ char *usage_msg[] = {
 
 "    -g     hex dump global color table (GCT)",
 "    -l     hex dump all local color tables (LCTs)",
+"    -v     check LZW data without decoding (unless -p or -b)",
 "",
 "   -p filename and -z filename will have a 3-digit frame number",
 "   (0-based) appended.",
@@ -32,6 +33,7 @@ char *usage_msg[] = {
 #define OPT_BMP                     0x004
 #define OPT_GCT                     0x008
 #define OPT_LCT                     0x010
+#define OPT_VALIDATE                0x020
 
 #define DUMP_SUBBLOCKS 0
 
@@ -107,12 +109,14 @@ void dump_ct(char *baddr, size_t num_entries)
 }
 
 static int chsz = -1;
+/* Decode the image data sub-blocks as they are in the file. */
 void lzd(char *px, Word image_size, char *lzwbuf, Word lzwbufcnt, Word lzw_min_code_size)
 {
     void *st;
     Word in_avail = lzwbufcnt;
     Word out_avail = image_size;
     glzwd_init(&st, lzw_min_code_size);
+    glzwd_set_option(st, GLZWD_OPT_SUBBLOCKS, 1);
     //printf("inited lz\n");
     if (chsz <= 0)
         chsz = lzwbufcnt;
@@ -200,14 +204,11 @@ Byte *do_image(int opts, int framenum, char *infile, char *pixelfile,
     printf("0x%0lx:: Image data:\n", (Dword)((char *)p - d));
     Word lzw_min_code_size = getbyte(&p);
     printf("LZW init code size:%u\n", lzw_min_code_size);
-    char *lzwbuf = (char *)mmalloc(image_size);
-    char *t = lzwbuf;
-    char *tlimit = lzwbuf + image_size;
-    /* lzwbuf is as large as image size; since it's "compressed" it should
-     * be large enough to hold the compressed data of the image. This may
-     * not be the case, so we will check for space and use realloc
-     * if needed.
-     * */
+    /* The sub-blocks are only copied out (de-blocked) for -z and -v; the
+     * decoder reads them as they are.  They are totalled first, so the
+     * copy is as large as the LZW data rather than the image. */
+    int deblock = (opts & (OPT_LZW | OPT_VALIDATE)) != 0;
+    Word net_size = 0;
     unsigned char *p0 = p;
     for (;;) {
         Word subblocksize = getbyte(&p);
@@ -219,23 +220,23 @@ Byte *do_image(int opts, int framenum, char *infile, char *pixelfile,
 #if DUMP_SUBBLOCKS
         xdump((char *)p, subblocksize, 0x234);
 #endif
-        if (t + subblocksize > tlimit) {
-            /* TODO: check this out; test if possible.
-             * Need special case GIF to test it.
-             * */
-            size_t toffset = t - lzwbuf;
-            size_t new_bufsize = tlimit - lzwbuf + subblocksize;
-            lzwbuf = (char *)mrealloc(lzwbuf, new_bufsize);
-            t = lzwbuf + toffset;
-            tlimit = lzwbuf + new_bufsize;
-        }
-        memmove(t, p, subblocksize);
-        t += subblocksize;
+        net_size += subblocksize;
         p += subblocksize;
     }
+    char *lzwbuf = deblock ? (char *)mmalloc(net_size + 1) : NULL;
+    char *t = lzwbuf;
+    if (deblock) {
+        unsigned char *q = p0;
+        Word subblocksize;
+        while ((subblocksize = *q++) != 0) {
+            memmove(t, q, subblocksize);
+            t += subblocksize;
+            q += subblocksize;
+        }
+    }
 
     printf("LZW data size:%lu  image_size:%lu  net data size:%lu\n",
-        (Dword)(p - p0), (Dword)image_size, (Dword)(t - lzwbuf));
+        (Dword)(p - p0), (Dword)image_size, (Dword)net_size);
     int todump = p - p0;
 #if DUMP_RAW_LZW
     if (todump > 64) todump = 64;
@@ -258,9 +259,23 @@ Byte *do_image(int opts, int framenum, char *infile, char *pixelfile,
     if (todump > 64) todump = 64;
     xdump((char *)lzwbuf, todump, 0);
 #endif
+    if (opts & OPT_VALIDATE) {
+        Glzwd_stats stats;
+        int r = glzwd_validate((Byte *)lzwbuf, t - lzwbuf, lzw_min_code_size,
+                                                                    &stats);
+        printf("LZW check: %d  decoded size:%u  codes:%u  clears:%u  "
+                "at byte:%u bit:%u\n", r, stats.out_size, stats.ncodes,
+                stats.nclears, stats.in_bit / 8, stats.in_bit % 8);
+        if (stats.out_size != image_size)
+            printf("!! decoded size is not image size\n");
+        if (!(opts & (OPT_PIXEL | OPT_BMP))) {
+            free(lzwbuf);
+            return p;
+        }
+    }
     char *px = (char *)mmalloc(image_size);
     memset(px, 0xba, image_size);
-    lzd(px, image_size, lzwbuf, t - lzwbuf, lzw_min_code_size);
+    lzd(px, image_size, (char *)p0, p - p0, lzw_min_code_size);
     //xdump((char *)px, image_size, 0);
     todump = image_size;
     if (opts & OPT_PIXEL) {
@@ -581,7 +596,7 @@ int main(int argc, char **argv)
 
     char *infile = NULL, *pixelfile = NULL, *lzwfile = NULL, *bmpfile = NULL;
 
-    while ((c = getopt(argc, argv, "hp:z:b:gl")) != -1) {
+    while ((c = getopt(argc, argv, "hp:z:b:glv")) != -1) {
         switch (c) {
             case 'h':
                 usage(usage_msg);
@@ -603,6 +618,9 @@ int main(int argc, char **argv)
             case 'l':
                 opts |= OPT_LCT;
                 break;
+            case 'v':
+                opts |= OPT_VALIDATE;
+                break;
         }
     }
     infile = argv[optind];
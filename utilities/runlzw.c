@@ -12,6 +12,9 @@
 #include "adler32.h"
 #include "glzwe.h"
 #include "glzwd.h"
+#include "glzwdp.h"
+#include "glzwdx.h"
+#include "glzwep.h"
 #include "xdump.h"
 
 
@@ -29,6 +32,22 @@ char *usage_msg[] = {
 "    -g only encode",
 "    -P print encoded codes",
 "    -D print decoded codes",
+"    -B decode with back-references (GLZWD_OPT_BACKREF)",
+"    -u also time unpacking codes only (glzwd_unpack)",
+"    -s decode with output slack (GLZWD_OPT_SLACK), also into random chunks",
+"    -p nthreads also time parallel decoding and encoding (glzwdp, glzwdp_split, glzwep)",
+"    -S size segment size for glzwep; default one segment per thread",
+"    -i also build a seek index and decode random ranges (glzwdx)",
+"    -c encode with the dense child table (GLZWE_OPT_DENSE)",
+"    -C also time encoding with the other tables",
+"    -L policy CLEAR policy: 0 when full, 1 never, 2 by ratio (GLZWE_OPT_CLEAR)",
+"    -F span encode with lookahead over span shorter strings (GLZWE_OPT_LOOKAHEAD)",
+"    -T table hash table: 0 8192 slots, 1 4801 slots (GLZWE_OPT_TABLE)",
+"    -Q try the last child found before the hash table, and print hits (GLZWE_OPT_PREDICT)",
+"    -R encode runs of one byte without the hash table (GLZWE_OPT_RUNS)",
+"    -l mode literal codes: 0 off, 1 always, 2 while LZW gains nothing (GLZWE_OPT_LITERAL)",
+"    -k also encode and decode sub-blocks and check them (GLZWE_OPT_SUBBLOCKS,",
+"       GLZWD_OPT_SUBBLOCKS)",
 "    -h print usage message",
     NULL
     };
@@ -44,10 +63,39 @@ char *usage_msg[] = {
 #define OPT_ONLY_ENCODE             0x100
 #define OPT_PRINT_ENCODED_CODES     0x200
 #define OPT_PRINT_DECODED_CODES     0x400
+#define OPT_BACKREF                 0x800
+#define OPT_UNPACK                  0x1000
+#define OPT_SLACK                   0x2000
+#define OPT_PARALLEL                0x4000
+#define OPT_INDEX                   0x8000
+#define OPT_DENSE                   0x10000
+#define OPT_COMPARE_TABLES          0x20000
+#define OPT_SUBBLOCKS               0x40000
+#define OPT_RUNS                    0x80000
+#define OPT_PREDICT                 0x100000
+
+/* Bytes allocated after each decoder output buffer for -s. */
+#define DEC_SLACK                   8
 
 extern int nsuccesses, nfails, nreprobes, ninserts;
 extern int print_enc_codes, print_dec_codes;
 
+/* Threads for -p, and glzwep() segment size for -S. */
+int nthreads = 1;
+unsigned segment_size;
+
+/* Encoder CLEAR policy for -L. */
+int clear_policy = GLZWE_CLEAR_FULL;
+
+/* Encoder lookahead span for -F; 0 for none. */
+int lookahead;
+
+/* Encoder literal mode for -l. */
+int literal_mode = GLZWE_LITERAL_OFF;
+
+/* Encoder hash table for -T. */
+int hash_table = FASTER_HASH ? GLZWE_TABLE_POW2 : GLZWE_TABLE_PRIME;
+
 typedef unsigned char Byte;
 typedef unsigned int Uint;
 
@@ -62,6 +110,323 @@ typedef unsigned int Uint;
 #define OPT_PRINT_DECODED_CODES     0x400
  */
 #define ndeb 0
+
+/* Apply decoder options selected on the command line. */
+void set_decoder_options(int opts, void *decoder_state)
+{
+    int r = glzwd_set_option(decoder_state, GLZWD_OPT_BACKREF,
+                                                opts & OPT_BACKREF ? 1 : 0);
+    assert(r == 0);
+    r = glzwd_set_option(decoder_state, GLZWD_OPT_SLACK,
+                                            opts & OPT_SLACK ? DEC_SLACK : 0);
+    assert(r == 0);
+}
+
+/* Apply encoder options selected on the command line. */
+void set_encoder_options(int opts, void *encoder_state)
+{
+    int r = glzwe_set_option(encoder_state, GLZWE_OPT_DENSE,
+                                                opts & OPT_DENSE ? 1 : 0);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_CLEAR, clear_policy);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_LOOKAHEAD, lookahead);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_TABLE, hash_table);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_LITERAL, literal_mode);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_RUNS,
+                                                opts & OPT_RUNS ? 1 : 0);
+    assert(r == 0);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_PREDICT,
+                                                opts & OPT_PREDICT ? 1 : 0);
+    assert(r == 0);
+}
+
+/* Print the GLZWE_OPT_PREDICT counts for -Q. */
+void print_predict(int opts, void *encoder_state)
+{
+    Glzwe_state *st = (Glzwe_state *)encoder_state;
+    unsigned long n = st->pred_hits + st->pred_misses;
+    if (!(opts & OPT_PREDICT))
+        return;
+    printf("%8lu predicted\n%8lu not predicted (%.1f%% predicted)\n",
+            st->pred_hits, st->pred_misses,
+            n ? 100.0 * st->pred_hits / n : 0.0);
+}
+
+/* Encode again with one encoder table and check the output is the same.
+ * table is a GLZWE_TABLE_ value, or -1 for the dense table. */
+void run_table(int opts, int table, Uint lzw_min_code_size, Byte *p, int n,
+        Byte *enc_buf, Uint enc_size)
+{
+    static const char *names[] = {"dense", "pow2 hash", "prime hash"};
+    int r, save_table = hash_table;
+    void *encoder_state;
+    Uint in_avail = n, out_avail = enc_size + 1;
+    Byte *buf = (Byte *)malloc(out_avail);
+    assert(buf);
+    if (table < 0) {
+        opts |= OPT_DENSE;
+    } else {
+        opts &= ~OPT_DENSE;
+        hash_table = table;
+    }
+    clock_t nticks = clock();
+    r = glzwe_init(&encoder_state, lzw_min_code_size);
+    assert(r == 0);
+    set_encoder_options(opts, encoder_state);
+    r = glzwe(encoder_state, p, buf, &in_avail, &out_avail, 1);
+    assert(r == 0);
+    glzwe_end(encoder_state);
+    nticks = clock() - nticks;
+    hash_table = save_table;
+    assert(out_avail == 1);
+    assert(!memcmp(buf, enc_buf, enc_size));
+    long millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+    if ( nticks < 0 )
+        printf("***timer error: %ld\n", -nticks);
+    else
+        printf("encoded (%s table) in: %ld.%02ld sec\n", names[table + 1],
+            millisecs/1000, ((millisecs%1000)+5)/10);
+    free(buf);
+}
+
+/* Decode the sub-blocks with GLZWD_OPT_SUBBLOCKS, in input chunks of random
+ * size, and check the output and that the input ends at the terminator. */
+void run_subblocks_decode(int opts, Uint lzw_min_code_size, Byte *p, int n,
+        Byte *buf, Uint len)
+{
+    int r;
+    void *decoder_state;
+    Uint in_used = 0, in_avail, out_avail = n, k;
+    Byte *dec_buf = (Byte *)malloc(n + DEC_SLACK);
+    assert(dec_buf);
+    r = glzwd_init(&decoder_state, lzw_min_code_size);
+    assert(r == 0);
+    set_decoder_options(opts, decoder_state);
+    r = glzwd_set_option(decoder_state, GLZWD_OPT_SUBBLOCKS, 1);
+    assert(r == 0);
+    do {
+        /* One byte more than the sub-blocks, which must not be read. */
+        in_avail = rand() % 300 + 1;
+        if (in_avail > len + 1 - in_used)
+            in_avail = len + 1 - in_used;
+        k = in_avail;
+        r = glzwd(decoder_state, buf + in_used, dec_buf + n - out_avail,
+                                                    &in_avail, &out_avail);
+        in_used += k - in_avail;
+    } while (r == GLZW_NO_INPUT_AVAIL && in_used <= len);
+    assert(r == 0);
+    assert(in_used == len && out_avail == 0);
+    assert(!memcmp(dec_buf, p, n));
+    glzwd_end(decoder_state);
+    free(dec_buf);
+}
+
+/* For -s: decode again into output chunks of random size, each its own
+ * buffer with only DEC_SLACK bytes after it, and check the output. */
+void run_slack_chunks(int opts, Uint lzw_min_code_size, Byte *p, int n,
+        Byte *enc_buf, Uint enc_size)
+{
+    int r;
+    void *decoder_state;
+    Uint in_avail = enc_size, out_avail, len = 0, k;
+    Byte *chunk;
+    r = glzwd_init(&decoder_state, lzw_min_code_size);
+    assert(r == 0);
+    set_decoder_options(opts, decoder_state);
+    do {
+        k = out_avail = rand() % 5000 + 1;
+        chunk = (Byte *)malloc(k + DEC_SLACK);
+        assert(chunk);
+        r = glzwd(decoder_state, enc_buf + enc_size - in_avail, chunk,
+                                                    &in_avail, &out_avail);
+        assert(out_avail <= k && len + k - out_avail <= (Uint)n);
+        assert(!memcmp(chunk, p + len, k - out_avail));
+        len += k - out_avail;
+        free(chunk);
+    } while (r == GLZW_NO_OUTPUT_AVAIL);
+    assert(r == 0);
+    assert(len == (Uint)n);
+    glzwd_end(decoder_state);
+}
+
+/* Encode again into sub-blocks, with output room for a few bytes at a
+ * time, check the blocks hold the same stream, and decode them. */
+void run_subblocks(int opts, Uint lzw_min_code_size, Byte *p, int n,
+        Byte *enc_buf, Uint enc_size)
+{
+    int r;
+    void *encoder_state;
+    Uint in_avail = n, out_avail, size = enc_size + enc_size / 255 + 2;
+    Uint len = 0, i, k;
+    Byte *buf = (Byte *)malloc(size + 1);
+    assert(buf);
+    r = glzwe_init(&encoder_state, lzw_min_code_size);
+    assert(r == 0);
+    set_encoder_options(opts, encoder_state);
+    r = glzwe_set_option(encoder_state, GLZWE_OPT_SUBBLOCKS, 1);
+    assert(r == 0);
+    do {
+        out_avail = rand() % 300 + 1;
+        if (out_avail > size - len)
+            out_avail = size - len;
+        k = out_avail;
+        r = glzwe(encoder_state, p + n - in_avail, buf + len, &in_avail,
+                                                            &out_avail, 1);
+        len += k - out_avail;
+    } while (r == GLZW_NO_OUTPUT_AVAIL && len < size);
+    assert(r == 0);
+    glzwe_end(encoder_state);
+    /* Full blocks, then a short one, then the terminator. */
+    for (i = 0, k = 0; buf[i]; i += buf[i] + 1) {
+        assert(i + buf[i] < len);
+        assert(buf[i] == 255 || !buf[i + buf[i] + 1]);
+        assert(!memcmp(buf + i + 1, enc_buf + k, buf[i]));
+        k += buf[i];
+    }
+    assert(k == enc_size && i == len - 1);
+    printf("sub-blocks: %u bytes\n", len);
+    buf[len] = 1;
+    run_subblocks_decode(opts, lzw_min_code_size, p, n, buf, len);
+    free(buf);
+}
+
+/* Encode again with each of the other encoder tables. */
+void run_other_tables(int opts, Uint lzw_min_code_size, Byte *p, int n,
+        Byte *enc_buf, Uint enc_size)
+{
+    int table;
+    for (table = -1; table <= GLZWE_TABLE_PRIME; table++)
+        if (table != (opts & OPT_DENSE ? -1 : hash_table))
+            run_table(opts, table, lzw_min_code_size, p, n, enc_buf,
+                                                                enc_size);
+}
+
+/* Decode with glzwdp() or glzwdp_split() and check the result. */
+void run_parallel(const char *name, int (*decode)(const GLZWByte *, GLZWUint,
+            GLZWUint, GLZWByte *, GLZWUint *, GLZWUint),
+        Uint lzw_min_code_size, Byte *enc_buf, Uint enc_size, Byte *p, int n)
+{
+    int i, r;
+    Byte *par_buf = (Byte *)malloc(n);
+    Uint par_avail = n;
+    assert(par_buf || !n);
+    clock_t nticks = clock();
+    r = decode(enc_buf, enc_size, lzw_min_code_size, par_buf, &par_avail,
+                                                                nthreads);
+    nticks = clock() - nticks;
+    assert(r == 0);
+    assert(par_avail == 0);
+    for (i = 0; i < n; i++)
+        assert(p[i] == par_buf[i]);
+    /* clock() is CPU time, summed over all threads. */
+    long millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+    if ( nticks < 0 )
+        printf("***timer error: %ld\n", -nticks);
+    else
+        printf("decoded (%s, %d threads) in: %ld.%02ld sec cpu\n",
+            name, nthreads, millisecs/1000, ((millisecs%1000)+5)/10);
+    free(par_buf);
+}
+
+/* Encode with glzwep(), and check the result decodes to the input. */
+void run_parallel_encode(Uint lzw_min_code_size, Byte *p, int n)
+{
+    int i, r;
+    void *decoder_state;
+    /* Room for 24 bits per byte, for segments of one byte. */
+    Uint enc_avail = 3 * n + 100, enc_size, in_avail, out_avail = n;
+    Byte *enc_buf = (Byte *)malloc(enc_avail);
+    Byte *dec_buf = (Byte *)malloc(n + 1);
+    assert(enc_buf && dec_buf);
+    clock_t nticks = clock();
+    r = glzwep(p, n, lzw_min_code_size, enc_buf, &enc_avail, segment_size,
+                                                                nthreads);
+    nticks = clock() - nticks;
+    assert(r == 0);
+    enc_size = 3 * n + 100 - enc_avail;
+    printf("encoded (glzwep) size: %u\n", enc_size);
+    /* clock() is CPU time, summed over all threads. */
+    long millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+    if ( nticks < 0 )
+        printf("***timer error: %ld\n", -nticks);
+    else
+        printf("encoded (glzwep, %d threads) in: %ld.%02ld sec cpu\n",
+            nthreads, millisecs/1000, ((millisecs%1000)+5)/10);
+    r = glzwd_init(&decoder_state, lzw_min_code_size);
+    assert(r == 0);
+    in_avail = enc_size;
+    out_avail = n + 1;
+    r = glzwd(decoder_state, enc_buf, dec_buf, &in_avail, &out_avail);
+    glzwd_end(decoder_state);
+    assert(r == 0);
+    assert(out_avail == 1);
+    for (i = 0; i < n; i++)
+        assert(p[i] == dec_buf[i]);
+    free(enc_buf);
+    free(dec_buf);
+}
+
+/* Build a seek index, save and reload it, and decode random ranges. */
+void run_index(Uint lzw_min_code_size, Byte *enc_buf, Uint enc_size,
+        Byte *p, int n)
+{
+    int i, k, r;
+    void *index, *index2;
+    Uint saved_size = 0, off, len, want, avail;
+    Byte *saved, *buf = (Byte *)malloc(4096);
+    assert(buf);
+    clock_t nticks = clock();
+    r = glzwdx_build(&index, enc_buf, enc_size, lzw_min_code_size);
+    nticks = clock() - nticks;
+    assert(r == 0);
+    assert(((Glzwdx_index *)index)->out_size == (Uint)n);
+    r = glzwdx_save(index, NULL, &saved_size);
+    assert(r == GLZW_NO_OUTPUT_AVAIL);
+    saved = (Byte *)malloc(saved_size);
+    assert(saved);
+    r = glzwdx_save(index, saved, &saved_size);
+    assert(r == 0);
+    r = glzwdx_load(&index2, saved, saved_size);
+    assert(r == 0);
+    printf("seek index: %d points, %d bytes saved\n",
+            ((Glzwdx_index *)index)->npoints, saved_size);
+    long millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+    if ( nticks < 0 )
+        printf("***timer error: %ld\n", -nticks);
+    else
+        printf("indexed in: %ld.%02ld sec\n",
+            millisecs/1000, ((millisecs%1000)+5)/10);
+    nticks = clock();
+    for (k = 0; k < 100; k++) {
+        off = n ? rand() % n : 0;
+        len = rand() % 4096;
+        avail = len;
+        r = glzwdx_decode(k & 1 ? index2 : index, enc_buf, enc_size, off,
+                                                            buf, &avail);
+        assert(r == 0);
+        /* A range past the end is cut short. */
+        want = len < n - off ? len : n - off;
+        assert(avail == len - want);
+        for (i = 0; i < (int)want; i++)
+            assert(buf[i] == p[off + i]);
+    }
+    nticks = clock() - nticks;
+    millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+    if ( nticks < 0 )
+        printf("***timer error: %ld\n", -nticks);
+    else
+        printf("decoded 100 ranges in: %ld.%02ld sec\n",
+            millisecs/1000, ((millisecs%1000)+5)/10);
+    glzwdx_end(index);
+    glzwdx_end(index2);
+    free(saved);
+    free(buf);
+}
+
 void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
 {
     int i, r;
@@ -89,11 +454,13 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
     clock_t nticks = clock();
     r = glzwe_init(&encoder_state, lzw_min_code_size);
     assert(r == 0);
+    set_encoder_options(opts, encoder_state);
     r = glzwe(encoder_state, p, enc_buf, &in_avail, &out_avail, end_of_data);
     if (r) {
         printf("ERROR: glzwe returned %d\n", r);
         return;
     }
+    print_predict(opts, encoder_state);
     glzwe_end(encoder_state);
     nticks = clock() - nticks;
     printf("done encoding: glzwe returned %d\n", r);
@@ -111,6 +478,12 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
 
     if(n<10)xdump(enc_buf, enc_size, 0);
 
+    if (opts & OPT_COMPARE_TABLES)
+        run_other_tables(opts, lzw_min_code_size, p, n, enc_buf, enc_size);
+
+    if (opts & OPT_SUBBLOCKS)
+        run_subblocks(opts, lzw_min_code_size, p, n, enc_buf, enc_size);
+
     if (opts & OPT_ENCODE) {
         FILE *fp = fopen(outfile, "wb");
         if (!fp) {
@@ -126,7 +499,7 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
         return;
 
     void *decoder_state;
-    Byte *dec_buf = (Byte *)malloc(n);
+    Byte *dec_buf = (Byte *)malloc(n + DEC_SLACK);
     assert(dec_buf);
     in_avail = enc_size;
     out_avail = n;
@@ -134,6 +507,7 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
     nticks = clock();
     r = glzwd_init(&decoder_state, lzw_min_code_size);
     assert(r == 0);
+    set_decoder_options(opts, decoder_state);
     r = glzwd(decoder_state, enc_buf, dec_buf, &in_avail, &out_avail);
     if (r) {
         printf("ERROR: glzwd returned %d\n", r);
@@ -145,6 +519,7 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
     assert(out_avail == 0);
     int dec_size = n;
     printf("decoded size: %d\n", dec_size);
+    printf("decoder state: %d bytes\n", (int)sizeof(Glzwd_state));
 #if ndeb
     printf("adler: %08x\n", (Uint)adler32(dec_buf, dec_size));
 #endif
@@ -160,6 +535,39 @@ void run_single_chunk(int opts, int nbits, char *outfile, int n, Byte *p)
     for (i = 0; i < dec_size; i++)
         assert(p[i] == dec_buf[i]);
 #endif
+
+    if (opts & OPT_SLACK)
+        run_slack_chunks(opts, lzw_min_code_size, p, n, enc_buf, enc_size);
+
+    if (opts & OPT_UNPACK) {
+        /* Codes are at least 3 bits. */
+        Uint ncodes = enc_size * 8 / 3 + 1;
+        GLZWUshort *codes = (GLZWUshort *)malloc(ncodes * sizeof(GLZWUshort));
+        assert(codes);
+        nticks = clock();
+        r = glzwd_unpack(enc_buf, enc_size, lzw_min_code_size, codes, &ncodes);
+        nticks = clock() - nticks;
+        assert(r == 0);
+        printf("unpacked codes: %d\n", ncodes);
+        millisecs = (nticks * 1000L) / (long)(CLOCKS_PER_SEC);
+        if ( nticks < 0 )
+            printf("***timer error: %ld\n", -nticks);
+        else
+            printf("unpacked in: %ld.%02ld sec\n",
+                millisecs/1000, ((millisecs%1000)+5)/10);
+        free(codes);
+    }
+
+    if (opts & OPT_PARALLEL) {
+        run_parallel("glzwdp", glzwdp, lzw_min_code_size, enc_buf, enc_size,
+                                                                    p, n);
+        run_parallel("glzwdp_split", glzwdp_split, lzw_min_code_size,
+                                                    enc_buf, enc_size, p, n);
+        run_parallel_encode(lzw_min_code_size, p, n);
+    }
+
+    if (opts & OPT_INDEX)
+        run_index(lzw_min_code_size, enc_buf, enc_size, p, n);
 }
 
 void run_random_chunks(int opts, int nbits, char *outfile, int n, Byte *p)
@@ -188,6 +596,7 @@ void run_random_chunks(int opts, int nbits, char *outfile, int n, Byte *p)
     clock_t nticks = clock();
     r = glzwe_init(&encoder_state, lzw_min_code_size);
     assert(r == 0);
+    set_encoder_options(opts, encoder_state);
     /* Break and output into random chunks of 0-4 and 0-6 bytes. */
     Uint in_avail = rand() % 5;
             if (in_avail >= n) {
@@ -228,6 +637,7 @@ void run_random_chunks(int opts, int nbits, char *outfile, int n, Byte *p)
             return;
         }
     }
+    print_predict(opts, encoder_state);
     glzwe_end(encoder_state);
     nticks = clock() - nticks;
     printf("done encoding: glzwe called %d times\n", ncalls);
@@ -263,13 +673,14 @@ void run_random_chunks(int opts, int nbits, char *outfile, int n, Byte *p)
 
     void *decoder_state;
     enc_buf = enc_buf_init;
-    Byte *dec_buf = (Byte *)malloc(n);
+    Byte *dec_buf = (Byte *)malloc(n + DEC_SLACK);
     assert(dec_buf);
     Byte *dec_buf_init = dec_buf;
 
     nticks = clock();
     r = glzwd_init(&decoder_state, lzw_min_code_size);
     assert(r == 0);
+    set_decoder_options(opts, decoder_state);
 
     /* Break and output into random chunks of 0-12 and 0-16 bytes. */
     in_avail = rand() % 13;
@@ -297,7 +708,7 @@ void run_random_chunks(int opts, int nbits, char *outfile, int n, Byte *p)
 
         if (r == GLZW_NO_INPUT_AVAIL) {
             in_avail = rand() % 13;
-            int lefttogo = out_avail_used_tot - in_avail_used_tot;
+            int lefttogo = enc_size - in_avail_used_tot;
             if (in_avail >= lefttogo) {
                 in_avail = lefttogo;
             }
@@ -333,12 +744,13 @@ void try_decode(int opts, int nbits, char *outfile, Uint n, Byte *p)
 {
     int r;
     Uint dec_size = n * 2;
-    Byte *buf = (Byte *)malloc(dec_size);
+    Byte *buf = (Byte *)malloc(dec_size + DEC_SLACK);
     assert(buf);
     Uint lzw_min_code_size = nbits < 2 ? 2 : nbits;
     void *decoder_state;
     r = glzwd_init(&decoder_state, lzw_min_code_size);
     assert(r == 0);
+    set_decoder_options(opts, decoder_state);
     Uint in_avail = n;
     FILE *fp = fopen(outfile, "wb");
     if (!fp) {
@@ -452,7 +864,7 @@ int main(int argc, char **argv)
     char *infile = NULL, *outfile = NULL, *dumpfile = NULL;
     char *str_end;
 
-    while ((c = getopt(argc, argv, "hn:f:o:x:b:edrEgPD")) != -1) {
+    while ((c = getopt(argc, argv, "hn:f:o:x:b:edrEgPDBusp:S:icCL:F:T:kl:RQ")) != -1) {
         switch (c) {
             case 'h':
                 usage(usage_msg);
@@ -507,6 +919,76 @@ int main(int argc, char **argv)
                 opts |= OPT_PRINT_DECODED_CODES;
                 print_dec_codes = 1;
                 break;
+            case 'B':
+                opts |= OPT_BACKREF;
+                break;
+            case 'u':
+                opts |= OPT_UNPACK;
+                break;
+            case 's':
+                opts |= OPT_SLACK;
+                break;
+            case 'p':
+                opts |= OPT_PARALLEL;
+                nthreads = strtoul(optarg, &str_end, 0);
+                if (*str_end) {
+                    printf("bad -p arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
+            case 'S':
+                segment_size = strtoul(optarg, &str_end, 0);
+                if (*str_end) {
+                    printf("bad -S arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
+            case 'i':
+                opts |= OPT_INDEX;
+                break;
+            case 'c':
+                opts |= OPT_DENSE;
+                break;
+            case 'C':
+                opts |= OPT_COMPARE_TABLES;
+                break;
+            case 'k':
+                opts |= OPT_SUBBLOCKS;
+                break;
+            case 'L':
+                clear_policy = strtoul(optarg, &str_end, 0);
+                if (*str_end || clear_policy > GLZWE_CLEAR_RATIO) {
+                    printf("bad -L arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
+            case 'F':
+                lookahead = strtoul(optarg, &str_end, 0);
+                if (*str_end || lookahead < 0) {
+                    printf("bad -F arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
+            case 'T':
+                hash_table = strtoul(optarg, &str_end, 0);
+                if (*str_end || hash_table > GLZWE_TABLE_PRIME) {
+                    printf("bad -T arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
+            case 'Q':
+                opts |= OPT_PREDICT;
+                break;
+            case 'R':
+                opts |= OPT_RUNS;
+                break;
+            case 'l':
+                literal_mode = strtoul(optarg, &str_end, 0);
+                if (*str_end || literal_mode > GLZWE_LITERAL_AUTO) {
+                    printf("bad -l arg: %s\n", optarg);
+                    usage(usage_msg);
+                }
+                break;
             default:
                 abort();
         }